@@ -0,0 +1,152 @@
+#ifndef EGL_CONTEXT_HPP_INCLUDED
+#define EGL_CONTEXT_HPP_INCLUDED
+
+#include <stdexcept>
+#include <string>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+//! Windowless OpenGL context for headless rendering. Uses the Mesa
+//! surfaceless platform when the client supports it, so no display server
+//! is needed, and otherwise the default display. The context is made
+//! current without a surface if EGL_KHR_surfaceless_context is available,
+//! else with a 1x1 pbuffer. Either way all rendering must go to a
+//! framebuffer object. Throws std::runtime_error on failure.
+class EglContext {
+public:
+  EglContext(int const major_version, int const minor_version)
+    : _display(EGL_NO_DISPLAY)
+    , _surface(EGL_NO_SURFACE)
+    , _context(EGL_NO_CONTEXT) {
+    _display = getDisplay();
+    if (_display == EGL_NO_DISPLAY) {
+      throw std::runtime_error("EGL: no display");
+    }
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (!eglInitialize(_display, &major, &minor)) {
+      throw std::runtime_error("EGL: initialize error");
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+      release();
+      throw std::runtime_error("EGL: desktop OpenGL not supported");
+    }
+
+    EGLint const config_attribs[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_RED_SIZE, 8,
+      EGL_GREEN_SIZE, 8,
+      EGL_BLUE_SIZE, 8,
+      EGL_NONE
+    };
+    EGLConfig config;
+    EGLint config_count = 0;
+    if (!eglChooseConfig(_display, config_attribs, &config, 1, &config_count) ||
+        config_count == 0) {
+      release();
+      throw std::runtime_error("EGL: no matching config");
+    }
+
+    EGLint const context_attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION_KHR, major_version,
+      EGL_CONTEXT_MINOR_VERSION_KHR, minor_version,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+      EGL_NONE
+    };
+    _context = eglCreateContext(_display, config, EGL_NO_CONTEXT,
+                                context_attribs);
+    if (_context == EGL_NO_CONTEXT) {
+      release();
+      throw std::runtime_error("EGL: create context error");
+    }
+
+    if (!hasExtension(eglQueryString(_display, EGL_EXTENSIONS),
+                      "EGL_KHR_surfaceless_context")) {
+      EGLint const pbuffer_attribs[] = {
+        EGL_WIDTH, 1,
+        EGL_HEIGHT, 1,
+        EGL_NONE
+      };
+      _surface = eglCreatePbufferSurface(_display, config, pbuffer_attribs);
+      if (_surface == EGL_NO_SURFACE) {
+        release();
+        throw std::runtime_error("EGL: create pbuffer error");
+      }
+    }
+    if (!eglMakeCurrent(_display, _surface, _surface, _context)) {
+      release();
+      throw std::runtime_error("EGL: make current error");
+    }
+  }
+
+  ~EglContext() {
+    release();
+  }
+
+  //! True if the context has no surface at all.
+  bool
+  surfaceless() const {
+    return _surface == EGL_NO_SURFACE;
+  }
+
+private:
+  EglContext(EglContext const&); // Not copyable.
+  EglContext& operator=(EglContext const&);
+
+  static bool
+  hasExtension(char const* extensions, char const* name) {
+    if (extensions == nullptr) {
+      return false;
+    }
+    std::string const padded = std::string(" ") + extensions + " ";
+    return padded.find(std::string(" ") + name + " ") != std::string::npos;
+  }
+
+  static EGLDisplay
+  getDisplay() {
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    if (hasExtension(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS),
+                     "EGL_MESA_platform_surfaceless")) {
+      PFNEGLGETPLATFORMDISPLAYEXTPROC const getPlatformDisplay =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+          eglGetProcAddress("eglGetPlatformDisplayEXT"));
+      if (getPlatformDisplay != nullptr) {
+        EGLDisplay const display = getPlatformDisplay(
+          EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY) {
+          return display;
+        }
+      }
+    }
+#endif
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+  void
+  release() {
+    if (_display == EGL_NO_DISPLAY) {
+      return;
+    }
+    eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (_surface != EGL_NO_SURFACE) {
+      eglDestroySurface(_display, _surface);
+      _surface = EGL_NO_SURFACE;
+    }
+    if (_context != EGL_NO_CONTEXT) {
+      eglDestroyContext(_display, _context);
+      _context = EGL_NO_CONTEXT;
+    }
+    eglTerminate(_display);
+    _display = EGL_NO_DISPLAY;
+  }
+
+private: // Member variables.
+  EGLDisplay _display;
+  EGLSurface _surface;
+  EGLContext _context;
+};
+
+#endif // EGL_CONTEXT_HPP_INCLUDED
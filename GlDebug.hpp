@@ -0,0 +1,90 @@
+#ifndef GL_DEBUG_HPP_INCLUDED
+#define GL_DEBUG_HPP_INCLUDED
+
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#include <GL/glew.h>
+#include <nDjinn.hpp>
+
+//! glGetError check after a GL call, named for the error message. Every
+//! check is a round trip to the driver, so they are only compiled in
+//! with YUV_VALENCE_GL_CHECKS, which CMake defines for Debug builds or
+//! with -DGL_ERROR_CHECKS=ON. Release builds rely on the debug output
+//! callback of enableDebugOutput() instead.
+#ifdef YUV_VALENCE_GL_CHECKS
+#define GL_CHECK(name) ndj::checkError(name)
+#else
+#define GL_CHECK(name) ((void)0)
+#endif
+
+//! Short name of a KHR_debug message source.
+inline char const*
+debugSourceName(GLenum const source) {
+  switch (source) {
+  case GL_DEBUG_SOURCE_API: return "api";
+  case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+  case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+  case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+  case GL_DEBUG_SOURCE_APPLICATION: return "application";
+  default: return "other";
+  }
+}
+
+//! Short name of a KHR_debug message type.
+inline char const*
+debugTypeName(GLenum const type) {
+  switch (type) {
+  case GL_DEBUG_TYPE_ERROR: return "error";
+  case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+  case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+  case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+  case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+  case GL_DEBUG_TYPE_MARKER: return "marker";
+  default: return "other";
+  }
+}
+
+//! Logs a KHR_debug message to std::cerr. Without synchronous output the
+//! driver may call this from any thread, so writes are serialized.
+inline void GLAPIENTRY
+debugMessageCallback(GLenum const source, GLenum const type, GLuint const id,
+                     GLenum const severity, GLsizei const length,
+                     GLchar const* const message, void const* /*user_param*/) {
+  static std::mutex mutex;
+  char const* severity_name = "low";
+  if (severity == GL_DEBUG_SEVERITY_HIGH) {
+    severity_name = "high";
+  }
+  else if (severity == GL_DEBUG_SEVERITY_MEDIUM) {
+    severity_name = "medium";
+  }
+  std::lock_guard<std::mutex> const lock(mutex);
+  std::cerr << "GL debug (" << severity_name << ", "
+            << debugSourceName(source) << " " << debugTypeName(type)
+            << ", id " << id << "): "
+            << std::string(message, length > 0 ? length : 0) << std::endl;
+}
+
+//! Registers debugMessageCallback() for all messages above notification
+//! severity. Synchronous output reports a message inside the offending
+//! call, so a breakpoint in the callback shows its stack, but serializes
+//! the driver; use it in debug builds only. Returns false if neither GL
+//! 4.3 nor KHR_debug is available.
+inline bool
+enableDebugOutput(bool const synchronous) {
+  if (!GLEW_VERSION_4_3 && !GLEW_KHR_debug) {
+    return false;
+  }
+  glEnable(GL_DEBUG_OUTPUT);
+  if (synchronous) {
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  }
+  glDebugMessageCallback(debugMessageCallback, nullptr);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE,
+                        GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+  return true;
+}
+
+#endif // GL_DEBUG_HPP_INCLUDED
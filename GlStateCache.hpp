@@ -0,0 +1,228 @@
+#ifndef GL_STATE_CACHE_HPP_INCLUDED
+#define GL_STATE_CACHE_HPP_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+//! Shadow copy of the GL bindings the render passes change every frame:
+//! program, vertex array, draw and read framebuffer, texture units,
+//! viewport and the draw and read buffers of each framebuffer. Calls that
+//! would not change the state are skipped and counted. Passes using the
+//! cache leave their bindings in place instead of unbinding, so code that
+//! changes this state directly, or relies on the default bindings (e.g.
+//! creating buffers while no vertex array is bound), must hold a Bypass.
+class GlStateCache {
+public:
+  //! Restores the default bindings for the enclosing block, then forgets
+  //! all state, since the block may change anything.
+  class Bypass {
+  public:
+    explicit
+    Bypass(GlStateCache& cache)
+      : _cache(cache) {
+      _cache.reset();
+    }
+
+    ~Bypass() {
+      _cache.invalidate();
+    }
+
+  private:
+    Bypass(Bypass const&);
+    Bypass& operator=(Bypass const&);
+
+  private: // Member variables.
+    GlStateCache& _cache;
+  };
+
+  GlStateCache()
+    : _issued(0)
+    , _skipped(0)
+    , _frame_issued(0)
+    , _frame_skipped(0) {
+    invalidate();
+  }
+
+  void
+  useProgram(GLuint const program) {
+    if (update(&_program, program)) {
+      glUseProgram(program);
+    }
+  }
+
+  void
+  bindVertexArray(GLuint const vertex_array) {
+    if (update(&_vertex_array, vertex_array)) {
+      glBindVertexArray(vertex_array);
+    }
+  }
+
+  //! target is GL_DRAW_FRAMEBUFFER or GL_READ_FRAMEBUFFER.
+  void
+  bindFramebuffer(GLenum const target, GLuint const framebuffer) {
+    GLuint* const current =
+      target == GL_READ_FRAMEBUFFER ? &_read_framebuffer : &_draw_framebuffer;
+    if (update(current, framebuffer)) {
+      glBindFramebuffer(target, framebuffer);
+    }
+  }
+
+  void
+  activeTexture(GLenum const unit) {
+    if (update(&_active_texture, unit)) {
+      glActiveTexture(unit);
+    }
+  }
+
+  //! Binds to the given unit, selecting it first if needed.
+  void
+  bindTexture(GLenum const unit, GLenum const target, GLuint const texture) {
+    std::pair<GLenum, GLenum> const key(unit, target);
+    std::map<std::pair<GLenum, GLenum>, GLuint>::iterator const iter =
+      _textures.find(key);
+    if (iter != _textures.end() && iter->second == texture) {
+      ++_skipped;
+      return;
+    }
+    activeTexture(unit);
+    glBindTexture(target, texture);
+    _textures[key] = texture;
+    ++_issued;
+  }
+
+  void
+  viewport(GLint const x, GLint const y,
+           GLsizei const width, GLsizei const height) {
+    std::array<GLint, 4> const viewport = {{ x, y, width, height }};
+    if (update(&_viewport, viewport)) {
+      glViewport(x, y, width, height);
+    }
+  }
+
+  //! Draw buffers of the bound draw framebuffer.
+  template <std::size_t N>
+  void
+  drawBuffers(std::array<GLenum, N> const& bufs) {
+    std::vector<GLenum> const buffers(bufs.begin(), bufs.end());
+    if (update(&_draw_buffers[_draw_framebuffer], buffers)) {
+      glDrawBuffers(static_cast<GLsizei>(N), bufs.data());
+    }
+  }
+
+  //! Read buffer of the bound read framebuffer.
+  void
+  readBuffer(GLenum const buffer) {
+    std::map<GLuint, GLenum>::iterator const iter =
+      _read_buffers.find(_read_framebuffer);
+    if (iter != _read_buffers.end() && iter->second == buffer) {
+      ++_skipped;
+      return;
+    }
+    glReadBuffer(buffer);
+    _read_buffers[_read_framebuffer] = buffer;
+    ++_issued;
+  }
+
+  //! Binds the defaults: program, vertex array, framebuffers and all
+  //! textures this cache bound to 0, texture unit 0.
+  void
+  reset() {
+    useProgram(0);
+    bindVertexArray(0);
+    bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    for (std::map<std::pair<GLenum, GLenum>, GLuint>::const_iterator iter =
+           _textures.begin(); iter != _textures.end(); ++iter) {
+      if (iter->second != 0) {
+        bindTexture(iter->first.first, iter->first.second, 0);
+      }
+    }
+    activeTexture(GL_TEXTURE0);
+  }
+
+  //! Forgets all state, the next call of each kind is issued.
+  void
+  invalidate() {
+    GLuint const unknown = ~GLuint(0);
+    _program = unknown;
+    _vertex_array = unknown;
+    _draw_framebuffer = unknown;
+    _read_framebuffer = unknown;
+    _active_texture = unknown;
+    _textures.clear();
+    _viewport.fill(-1);
+    _draw_buffers.clear();
+    _read_buffers.clear();
+  }
+
+  //! Call at the end of a frame to make its counts available as
+  //! frameIssued() and frameSkipped().
+  void
+  endFrame() {
+    _frame_issued = _issued;
+    _frame_skipped = _skipped;
+    _issued = 0;
+    _skipped = 0;
+  }
+
+  //! GL calls issued and skipped since the last endFrame().
+  std::size_t
+  issued() const {
+    return _issued;
+  }
+
+  std::size_t
+  skipped() const {
+    return _skipped;
+  }
+
+  //! Counts of the last frame passed to endFrame().
+  std::size_t
+  frameIssued() const {
+    return _frame_issued;
+  }
+
+  std::size_t
+  frameSkipped() const {
+    return _frame_skipped;
+  }
+
+private:
+  GlStateCache(GlStateCache const&);
+  GlStateCache& operator=(GlStateCache const&);
+
+  //! Sets *current to value and returns true if they differed.
+  template <typename T>
+  bool
+  update(T* const current, T const& value) {
+    if (*current == value) {
+      ++_skipped;
+      return false;
+    }
+    *current = value;
+    ++_issued;
+    return true;
+  }
+
+private: // Member variables.
+  GLuint _program;
+  GLuint _vertex_array;
+  GLuint _draw_framebuffer;
+  GLuint _read_framebuffer;
+  GLenum _active_texture;
+  std::map<std::pair<GLenum, GLenum>, GLuint> _textures; // (unit, target).
+  std::array<GLint, 4> _viewport;
+  std::map<GLuint, std::vector<GLenum>> _draw_buffers; // By framebuffer.
+  std::map<GLuint, GLenum> _read_buffers;
+  std::size_t _issued;
+  std::size_t _skipped;
+  std::size_t _frame_issued;
+  std::size_t _frame_skipped;
+};
+
+#endif // GL_STATE_CACHE_HPP_INCLUDED
@@ -0,0 +1,92 @@
+#ifndef LATTICE_MESH_HPP_INCLUDED
+#define LATTICE_MESH_HPP_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Parallel.hpp"
+#include "Random.hpp"
+
+//! Quads per column strip when emitting lattice triangles. Two rows of a
+//! strip, 2 * (kLatticeStripWidth + 1) vertices, fit in a 32 entry
+//! post-transform cache.
+std::size_t const kLatticeStripWidth = 14;
+
+//! Jittered square lattice covering [x_min, x_max] with closed-form
+//! connectivity, no triangulation needed. Each vertex is moved by up to
+//! jitter * spacing along each axis. For jitter below 0.25 every quad
+//! stays convex, so both diagonals give counter-clockwise triangles; the
+//! shorter one is used. Triangles are emitted in column strips, row by row
+//! within a strip, for post-transform vertex cache reuse. Tri must be
+//! constructible from three vertex indices.
+template <typename Tri>
+void
+makeJitteredLattice(float const spacing,
+                    float const jitter,
+                    std::array<float, 2> const& x_min,
+                    std::array<float, 2> const& x_max,
+                    std::uint32_t const seed,
+                    std::vector<std::array<float, 2>>* pos,
+                    std::vector<Tri>* tri_index) {
+  using namespace std;
+  assert(pos != nullptr);
+  assert(tri_index != nullptr);
+  assert(0.f <= jitter && jitter < 0.25f);
+
+  size_t const nx = max<size_t>(
+    1, static_cast<size_t>(ceil((x_max[0] - x_min[0]) / spacing)));
+  size_t const ny = max<size_t>(
+    1, static_cast<size_t>(ceil((x_max[1] - x_min[1]) / spacing)));
+  size_t const row = nx + 1;
+  pos->resize(row * (ny + 1));
+
+  uint64_t const key = streamKey(seed, kSampleStream);
+  float const amplitude = jitter * spacing;
+  array<float, 2>* const p = pos->data();
+  parallelFor(pos->size(), 16384, [=](size_t const begin, size_t const end) {
+    for (size_t v = begin; v < end; ++v) {
+      p[v][0] = x_min[0] + (v % row) * spacing +
+                uniformFloat(key, 2 * v + 0, -amplitude, amplitude);
+      p[v][1] = x_min[1] + (v / row) * spacing +
+                uniformFloat(key, 2 * v + 1, -amplitude, amplitude);
+    }
+  });
+
+  auto const distSq = [p](size_t const a, size_t const b) {
+    float const dx = p[a][0] - p[b][0];
+    float const dy = p[a][1] - p[b][1];
+    return dx * dx + dy * dy;
+  };
+
+  tri_index->clear();
+  tri_index->reserve(2 * nx * ny);
+  for (size_t x0 = 0; x0 < nx; x0 += kLatticeStripWidth) {
+    size_t const x1 = min(x0 + kLatticeStripWidth, nx);
+    for (size_t j = 0; j < ny; ++j) {
+      for (size_t i = x0; i < x1; ++i) {
+        // d - c
+        // |   |
+        // a - b
+        size_t const a = j * row + i;
+        size_t const b = a + 1;
+        size_t const c = a + row + 1;
+        size_t const d = a + row;
+        if (distSq(a, c) <= distSq(b, d)) {
+          tri_index->push_back(Tri(a, b, c));
+          tri_index->push_back(Tri(a, c, d));
+        }
+        else {
+          tri_index->push_back(Tri(a, b, d));
+          tri_index->push_back(Tri(b, c, d));
+        }
+      }
+    }
+  }
+}
+
+#endif // LATTICE_MESH_HPP_INCLUDED
@@ -0,0 +1,110 @@
+#ifndef MAPPED_FILE_HPP_INCLUDED
+#define MAPPED_FILE_HPP_INCLUDED
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//! Read-only memory mapping of an entire file. The mapping is released when
+//! the object is destroyed. A missing or empty file gives an unmapped object.
+class MappedFile {
+public:
+  explicit
+  MappedFile(std::string const& filename)
+    : _data(nullptr)
+    , _size(0) {
+#ifdef _WIN32
+    _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    _mapping = nullptr;
+    if (_file == INVALID_HANDLE_VALUE) {
+      return;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+      return;
+    }
+    _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping == nullptr) {
+      return;
+    }
+    _data = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (_data != nullptr) {
+      _size = static_cast<std::size_t>(size.QuadPart);
+    }
+#else
+    int const fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* const data = mmap(nullptr, static_cast<std::size_t>(st.st_size),
+                              PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        _data = data;
+        _size = static_cast<std::size_t>(st.st_size);
+      }
+    }
+    close(fd); // The mapping stays valid after the descriptor is closed.
+#endif
+  }
+
+  ~MappedFile() {
+#ifdef _WIN32
+    if (_data != nullptr) {
+      UnmapViewOfFile(_data);
+    }
+    if (_mapping != nullptr) {
+      CloseHandle(_mapping);
+    }
+    if (_file != INVALID_HANDLE_VALUE) {
+      CloseHandle(_file);
+    }
+#else
+    if (_data != nullptr) {
+      munmap(_data, _size);
+    }
+#endif
+  }
+
+  bool
+  isMapped() const {
+    return _data != nullptr;
+  }
+
+  void const*
+  data() const {
+    return _data;
+  }
+
+  std::size_t
+  size() const {
+    return _size;
+  }
+
+private:
+  MappedFile(MappedFile const&);
+  MappedFile& operator=(MappedFile const&);
+
+private: // Member variables.
+  void* _data;
+  std::size_t _size;
+#ifdef _WIN32
+  HANDLE _file;
+  HANDLE _mapping;
+#endif
+};
+
+#endif // MAPPED_FILE_HPP_INCLUDED
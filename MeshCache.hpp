@@ -0,0 +1,268 @@
+#ifndef MESH_CACHE_HPP_INCLUDED
+#define MESH_CACHE_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "MappedFile.hpp"
+
+//! 64-bit FNV-1a hash. Pass the previous result as hash to chain calls.
+inline std::uint64_t
+hashBytes(void const* data, std::size_t const size,
+          std::uint64_t hash = 14695981039346656037ULL) {
+  unsigned char const* bytes = static_cast<unsigned char const*>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+template <typename T>
+inline std::uint64_t
+hashValue(T const& value, std::uint64_t const hash = 14695981039346656037ULL) {
+  return hashBytes(&value, sizeof(T), hash);
+}
+
+//! Vertex and triangle range of one level of a mesh pyramid. Levels share
+//! the vertex arrays: a level uses the first vertex_count vertices.
+struct MeshLevel {
+  std::uint64_t vertex_count;
+  std::uint64_t triangle_offset;
+  std::uint64_t triangle_count;
+};
+
+//! On-disk mesh in a flat binary layout that can be used straight from a
+//! memory mapping. The file holds a header followed by the obj_pos, yuv,
+//! tri_index and face_normal arrays, each starting at a 64 byte aligned
+//! offset. face_normal has one vertex sized element per triangle. Files are
+//! named by format version and a key hashed from the generating parameters,
+//! so a parameter or layout change never reads a stale file.
+class MeshCacheFile {
+public:
+  static std::uint32_t const kFormatVersion = 6;
+  static std::size_t const kMaxLevels = 16;
+
+  struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t vertex_size; // sizeof one obj_pos/yuv element.
+    std::uint32_t triangle_size; // sizeof one tri_index element.
+    std::uint32_t level_count;
+    std::uint64_t key;
+    std::uint64_t vertex_count;
+    std::uint64_t triangle_count;
+    std::uint64_t obj_pos_offset;
+    std::uint64_t yuv_offset;
+    std::uint64_t tri_index_offset;
+    std::uint64_t face_normal_offset;
+    MeshLevel levels[kMaxLevels];
+  };
+
+  //! Maps the file and validates the header against the expected key and
+  //! element sizes. Check valid() before reading arrays.
+  MeshCacheFile(std::string const& filename,
+                std::uint64_t const key,
+                std::size_t const vertex_size,
+                std::size_t const triangle_size)
+    : _file(filename)
+    , _header(nullptr) {
+    if (!_file.isMapped() || _file.size() < sizeof(Header)) {
+      return;
+    }
+    Header const* header = static_cast<Header const*>(_file.data());
+    if (std::memcmp(header->magic, magic(), sizeof(header->magic)) != 0 ||
+        header->version != kFormatVersion ||
+        header->key != key ||
+        header->vertex_size != vertex_size ||
+        header->triangle_size != triangle_size ||
+        header->level_count == 0 ||
+        header->level_count > kMaxLevels) {
+      return;
+    }
+    std::uint64_t const vertex_bytes = header->vertex_count * vertex_size;
+    std::uint64_t const triangle_bytes = header->triangle_count * triangle_size;
+    std::uint64_t const face_bytes = header->triangle_count * vertex_size;
+    if (header->obj_pos_offset + vertex_bytes > _file.size() ||
+        header->yuv_offset + vertex_bytes > _file.size() ||
+        header->tri_index_offset + triangle_bytes > _file.size() ||
+        header->face_normal_offset + face_bytes > _file.size()) {
+      return; // Truncated file.
+    }
+    for (std::uint32_t l = 0; l < header->level_count; ++l) {
+      MeshLevel const& level = header->levels[l];
+      if (level.vertex_count > header->vertex_count ||
+          level.triangle_offset + level.triangle_count >
+            header->triangle_count) {
+        return;
+      }
+    }
+    _header = header;
+  }
+
+  bool
+  valid() const {
+    return _header != nullptr;
+  }
+
+  std::size_t
+  vertexCount() const {
+    return static_cast<std::size_t>(_header->vertex_count);
+  }
+
+  std::size_t
+  triangleCount() const {
+    return static_cast<std::size_t>(_header->triangle_count);
+  }
+
+  std::vector<MeshLevel>
+  levels() const {
+    return std::vector<MeshLevel>(_header->levels,
+                                  _header->levels + _header->level_count);
+  }
+
+  template <typename V>
+  V const*
+  objPos() const {
+    return reinterpret_cast<V const*>(bytes() + _header->obj_pos_offset);
+  }
+
+  template <typename V>
+  V const*
+  yuv() const {
+    return reinterpret_cast<V const*>(bytes() + _header->yuv_offset);
+  }
+
+  template <typename T>
+  T const*
+  triIndex() const {
+    return reinterpret_cast<T const*>(bytes() + _header->tri_index_offset);
+  }
+
+  template <typename V>
+  V const*
+  faceNormal() const {
+    return reinterpret_cast<V const*>(bytes() + _header->face_normal_offset);
+  }
+
+  //! Writes a cache file. The data goes to a temporary file first which is
+  //! then renamed, so a concurrent reader never maps a partial file.
+  //! Returns false if the file could not be written.
+  template <typename V, typename T>
+  static bool
+  write(std::string const& filename,
+        std::uint64_t const key,
+        std::vector<V> const& obj_pos,
+        std::vector<V> const& yuv,
+        std::vector<T> const& tri_index,
+        std::vector<V> const& face_normal,
+        std::vector<MeshLevel> const& levels) {
+    if (levels.empty() || levels.size() > kMaxLevels ||
+        face_normal.size() != tri_index.size()) {
+      return false;
+    }
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, magic(), sizeof(header.magic));
+    header.version = kFormatVersion;
+    header.vertex_size = sizeof(V);
+    header.triangle_size = sizeof(T);
+    header.key = key;
+    header.vertex_count = obj_pos.size();
+    header.triangle_count = tri_index.size();
+    header.level_count = static_cast<std::uint32_t>(levels.size());
+    std::copy(levels.begin(), levels.end(), header.levels);
+    header.obj_pos_offset = alignOffset(sizeof(Header));
+    header.yuv_offset =
+      alignOffset(header.obj_pos_offset + obj_pos.size() * sizeof(V));
+    header.tri_index_offset =
+      alignOffset(header.yuv_offset + yuv.size() * sizeof(V));
+    header.face_normal_offset =
+      alignOffset(header.tri_index_offset + tri_index.size() * sizeof(T));
+
+    std::string const tmp_filename = filename + ".tmp";
+    {
+      std::ofstream ofs(tmp_filename,
+                        std::ios_base::out | std::ios_base::binary |
+                        std::ios_base::trunc);
+      if (!ofs) {
+        return false;
+      }
+      writePadded(ofs, &header, sizeof(header), header.obj_pos_offset);
+      writePadded(ofs, obj_pos.data(), obj_pos.size() * sizeof(V),
+                  header.yuv_offset - header.obj_pos_offset);
+      writePadded(ofs, yuv.data(), yuv.size() * sizeof(V),
+                  header.tri_index_offset - header.yuv_offset);
+      writePadded(ofs, tri_index.data(), tri_index.size() * sizeof(T),
+                  header.face_normal_offset - header.tri_index_offset);
+      ofs.write(reinterpret_cast<char const*>(face_normal.data()),
+                face_normal.size() * sizeof(V));
+      if (!ofs) {
+        ofs.close();
+        std::remove(tmp_filename.c_str());
+        return false;
+      }
+    }
+    std::remove(filename.c_str()); // rename() does not replace on Windows.
+    return std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+  }
+
+  //! Returns the file name for a key inside directory, which is created if
+  //! it does not exist.
+  static std::string
+  filename(std::string const& directory, std::uint64_t const key) {
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+    char name[64];
+    std::snprintf(name, sizeof(name), "/mesh-v%u-%016llx.bin",
+                  static_cast<unsigned>(kFormatVersion),
+                  static_cast<unsigned long long>(key));
+    return directory + name;
+  }
+
+private:
+  static char const*
+  magic() {
+    static char const kMagic[8] = { 'Y', 'U', 'V', 'M', 'E', 'S', 'H', '\0' };
+    return kMagic;
+  }
+
+  static std::uint64_t
+  alignOffset(std::uint64_t const offset) {
+    return (offset + 63) & ~std::uint64_t(63);
+  }
+
+  static void
+  writePadded(std::ofstream& ofs, void const* data, std::size_t const size,
+              std::uint64_t const padded_size) {
+    static char const zeros[64] = {};
+    ofs.write(static_cast<char const*>(data), size);
+    ofs.write(zeros, static_cast<std::streamsize>(padded_size - size));
+  }
+
+  unsigned char const*
+  bytes() const {
+    return static_cast<unsigned char const*>(_file.data());
+  }
+
+private: // Member variables.
+  MappedFile _file;
+  Header const* _header;
+};
+
+#endif // MESH_CACHE_HPP_INCLUDED
@@ -0,0 +1,108 @@
+#ifndef MESH_PYRAMID_HPP_INCLUDED
+#define MESH_PYRAMID_HPP_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "Random.hpp"
+
+//! Assigns each sample the coarsest pyramid level it belongs to. Level 0 is
+//! all samples; level l keeps a subset of level l - 1 in which samples are
+//! at least 2^l times their radius apart, so coarser levels are nested in
+//! finer ones. Each level is a greedy elimination pass in one random
+//! priority order, derived from seed, which is shared by all levels.
+inline std::vector<std::uint32_t>
+nestedSampleLevels(std::vector<std::array<float, 2>> const& samples,
+                   std::vector<float> const& sample_radius,
+                   std::uint32_t const level_count,
+                   std::uint32_t const seed) {
+  using namespace std;
+  size_t const n = samples.size();
+  vector<uint32_t> level_of(n, 0);
+  if (n == 0 || level_count <= 1) {
+    return level_of;
+  }
+
+  array<float, 2> x_min = samples[0];
+  array<float, 2> x_max = samples[0];
+  for (size_t i = 1; i < n; ++i) {
+    x_min[0] = min(x_min[0], samples[i][0]);
+    x_min[1] = min(x_min[1], samples[i][1]);
+    x_max[0] = max(x_max[0], samples[i][0]);
+    x_max[1] = max(x_max[1], samples[i][1]);
+  }
+  float const radius_min =
+    *min_element(sample_radius.begin(), sample_radius.end());
+  float const radius_max =
+    *max_element(sample_radius.begin(), sample_radius.end());
+
+  uint64_t const key = streamKey(seed, kPyramidStream);
+  vector<size_t> order(n);
+  iota(order.begin(), order.end(), size_t(0));
+  vector<uint64_t> priority(n);
+  for (size_t i = 0; i < n; ++i) {
+    priority[i] = counterHash(key, i);
+  }
+  sort(order.begin(), order.end(), [&](size_t const a, size_t const b) {
+    return priority[a] < priority[b];
+  });
+
+  vector<size_t> kept;
+  for (uint32_t level = 1; level < level_count; ++level) {
+    float const scale = static_cast<float>(1u << level);
+    float const cell_size = scale * radius_min / sqrt(2.f);
+    ptrdiff_t const gx =
+      static_cast<ptrdiff_t>((x_max[0] - x_min[0]) / cell_size) + 1;
+    ptrdiff_t const gy =
+      static_cast<ptrdiff_t>((x_max[1] - x_min[1]) / cell_size) + 1;
+    ptrdiff_t const reach =
+      static_cast<ptrdiff_t>(ceil(scale * radius_max / cell_size));
+    vector<int> grid(gx * gy, -1);
+    auto const cellOf = [&](size_t const s, ptrdiff_t const axis) {
+      return static_cast<ptrdiff_t>(
+        (samples[s][axis] - x_min[axis]) / cell_size);
+    };
+
+    kept.clear();
+    for (size_t o = 0; o < n; ++o) {
+      size_t const s = order[o];
+      if (level_of[s] + 1 < level) {
+        continue; // Not in the previous level.
+      }
+      ptrdiff_t const cx = cellOf(s, 0);
+      ptrdiff_t const cy = cellOf(s, 1);
+      bool free = true;
+      for (ptrdiff_t y = max<ptrdiff_t>(cy - reach, 0);
+           free && y <= min(cy + reach, gy - 1); ++y) {
+        for (ptrdiff_t x = max<ptrdiff_t>(cx - reach, 0);
+             x <= min(cx + reach, gx - 1); ++x) {
+          int const k = grid[y * gx + x];
+          if (k >= 0) {
+            float const d = scale * max(sample_radius[s], sample_radius[k]);
+            float const dx = samples[k][0] - samples[s][0];
+            float const dy = samples[k][1] - samples[s][1];
+            if (dx * dx + dy * dy < d * d) {
+              free = false;
+              break;
+            }
+          }
+        }
+      }
+      if (free) {
+        grid[cy * gx + cx] = static_cast<int>(s);
+        kept.push_back(s);
+      }
+    }
+    for (size_t k = 0; k < kept.size(); ++k) {
+      level_of[kept[k]] = level;
+    }
+  }
+  return level_of;
+}
+
+#endif // MESH_PYRAMID_HPP_INCLUDED
@@ -0,0 +1,47 @@
+#ifndef PARALLEL_HPP_INCLUDED
+#define PARALLEL_HPP_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+//! Number of worker threads to use, at least one.
+inline unsigned
+workerCount() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+//! Calls fn(begin, end) for consecutive chunks of [0, count). Chunk
+//! boundaries depend only on chunk_size, never on the number of threads,
+//! so per-element results do not change with the machine.
+template <typename F>
+void
+parallelFor(std::size_t const count, std::size_t const chunk_size, F fn) {
+  std::size_t const chunk_count = (count + chunk_size - 1) / chunk_size;
+  std::size_t const thread_count =
+    std::min<std::size_t>(workerCount(), chunk_count);
+  std::atomic<std::size_t> next_chunk(0);
+  auto const work = [&]() {
+    for (std::size_t c = next_chunk++; c < chunk_count; c = next_chunk++) {
+      std::size_t const begin = c * chunk_size;
+      fn(begin, std::min(begin + chunk_size, count));
+    }
+  };
+
+  if (thread_count <= 1) {
+    work();
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (std::size_t t = 1; t < thread_count; ++t) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (std::size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+}
+
+#endif // PARALLEL_HPP_INCLUDED
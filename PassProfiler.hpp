@@ -0,0 +1,245 @@
+#ifndef PASS_PROFILER_HPP_INCLUDED
+#define PASS_PROFILER_HPP_INCLUDED
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+//! GPU and CPU timing of named render passes. Each pass is bracketed by
+//! two GL_TIMESTAMP queries, so passes may nest, which GL_TIME_ELAPSED
+//! queries cannot. Queries come from a pool and are only read by poll()
+//! once available, i.e. a few frames late, so profiling never stalls the
+//! pipeline. The CPU time is the time spent issuing the pass. Statistics
+//! are over the last kWindow samples of each pass.
+class PassProfiler {
+public:
+  static std::size_t const kWindow = 256;
+
+  //! Times the enclosing block. A null profiler makes this a no-op, so
+  //! passes can stay instrumented with profiling off.
+  class Scope {
+  public:
+    Scope(PassProfiler* const profiler, char const* const name)
+      : _profiler(profiler)
+      , _token(profiler != nullptr ? profiler->begin(name) : 0) {}
+
+    ~Scope() {
+      if (_profiler != nullptr) {
+        _profiler->end(_token);
+      }
+    }
+
+  private:
+    Scope(Scope const&);
+    Scope& operator=(Scope const&);
+
+  private: // Member variables.
+    PassProfiler* _profiler;
+    std::uint64_t _token;
+  };
+
+  struct Stats {
+    double min_ms;
+    double avg_ms;
+    double p99_ms;
+  };
+
+  PassProfiler()
+    : _first_token(0) {}
+
+  ~PassProfiler() {
+    for (std::size_t r = 0; r < _pending.size(); ++r) {
+      _pool.push_back(_pending[r].start_query);
+      _pool.push_back(_pending[r].end_query);
+    }
+    if (!_pool.empty()) {
+      glDeleteQueries(static_cast<GLsizei>(_pool.size()), _pool.data());
+    }
+  }
+
+  //! Starts timing a pass, returns the token to pass to end().
+  std::uint64_t
+  begin(char const* const name) {
+    Record record;
+    record.pass = passIndex(name);
+    record.start_query = takeQuery();
+    record.end_query = takeQuery();
+    record.ended = false;
+    glQueryCounter(record.start_query, GL_TIMESTAMP);
+    record.cpu_start = std::chrono::steady_clock::now();
+    _pending.push_back(record);
+    return _first_token + _pending.size() - 1;
+  }
+
+  void
+  end(std::uint64_t const token) {
+    Record& record = _pending[static_cast<std::size_t>(token - _first_token)];
+    record.cpu_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - record.cpu_start).count();
+    glQueryCounter(record.end_query, GL_TIMESTAMP);
+    record.ended = true;
+  }
+
+  //! Collects the results of finished passes without waiting.
+  void
+  poll() {
+    while (!_pending.empty() && _pending.front().ended) {
+      Record const& record = _pending.front();
+      GLint available = GL_FALSE;
+      glGetQueryObjectiv(record.end_query, GL_QUERY_RESULT_AVAILABLE,
+                         &available);
+      if (available != GL_TRUE) {
+        return; // Later queries cannot be ready either.
+      }
+      GLuint64 start_ns = 0;
+      GLuint64 end_ns = 0;
+      glGetQueryObjectui64v(record.start_query, GL_QUERY_RESULT, &start_ns);
+      glGetQueryObjectui64v(record.end_query, GL_QUERY_RESULT, &end_ns);
+      Pass& pass = _passes[record.pass];
+      addSample(&pass.gpu_ms, pass.count, (end_ns - start_ns) * 1e-6);
+      addSample(&pass.cpu_ms, pass.count, record.cpu_ms);
+      ++pass.count;
+      _pool.push_back(record.start_query);
+      _pool.push_back(record.end_query);
+      _pending.pop_front();
+      ++_first_token;
+    }
+  }
+
+  //! Waits for all ended passes and collects their results.
+  void
+  finish() {
+    glFinish();
+    poll();
+  }
+
+  //! One line per pass: sample count, GPU and CPU min/avg/p99 in ms.
+  void
+  report(std::ostream& os) const {
+    for (std::size_t p = 0; p < _passes.size(); ++p) {
+      Pass const& pass = _passes[p];
+      Stats const gpu = stats(pass.gpu_ms);
+      Stats const cpu = stats(pass.cpu_ms);
+      os << pass.name << ": " << pass.count << " samples, gpu "
+         << gpu.min_ms << "/" << gpu.avg_ms << "/" << gpu.p99_ms
+         << " ms, cpu "
+         << cpu.min_ms << "/" << cpu.avg_ms << "/" << cpu.p99_ms
+         << " ms (min/avg/p99)\n";
+    }
+  }
+
+  //! Writes the statistics as a JSON object keyed by pass name. Returns
+  //! false if the file could not be written.
+  bool
+  writeJson(std::string const& filename) const {
+    std::ofstream ofs(filename);
+    ofs << "{\n";
+    for (std::size_t p = 0; p < _passes.size(); ++p) {
+      Pass const& pass = _passes[p];
+      ofs << "  \"" << pass.name << "\": {\n"
+          << "    \"samples\": " << pass.count << ",\n"
+          << "    \"gpu_ms\": " << statsJson(stats(pass.gpu_ms)) << ",\n"
+          << "    \"cpu_ms\": " << statsJson(stats(pass.cpu_ms)) << "\n"
+          << "  }" << (p + 1 < _passes.size() ? "," : "") << "\n";
+    }
+    ofs << "}\n";
+    return static_cast<bool>(ofs);
+  }
+
+private:
+  PassProfiler(PassProfiler const&);
+  PassProfiler& operator=(PassProfiler const&);
+
+  struct Pass {
+    std::string name;
+    std::uint64_t count;
+    std::vector<double> gpu_ms; // Ring of the last kWindow samples.
+    std::vector<double> cpu_ms;
+  };
+
+  struct Record {
+    std::size_t pass;
+    GLuint start_query;
+    GLuint end_query;
+    bool ended;
+    std::chrono::steady_clock::time_point cpu_start;
+    double cpu_ms;
+  };
+
+  std::size_t
+  passIndex(char const* const name) {
+    for (std::size_t p = 0; p < _passes.size(); ++p) {
+      if (_passes[p].name == name) {
+        return p;
+      }
+    }
+    Pass pass;
+    pass.name = name;
+    pass.count = 0;
+    _passes.push_back(pass);
+    return _passes.size() - 1;
+  }
+
+  GLuint
+  takeQuery() {
+    if (_pool.empty()) {
+      GLuint query = 0;
+      glGenQueries(1, &query);
+      return query;
+    }
+    GLuint const query = _pool.back();
+    _pool.pop_back();
+    return query;
+  }
+
+  static void
+  addSample(std::vector<double>* const window, std::uint64_t const count,
+            double const ms) {
+    if (window->size() < kWindow) {
+      window->push_back(ms);
+    }
+    else {
+      (*window)[count % kWindow] = ms;
+    }
+  }
+
+  static Stats
+  stats(std::vector<double> window) {
+    Stats result = { 0., 0., 0. };
+    if (window.empty()) {
+      return result;
+    }
+    std::sort(window.begin(), window.end());
+    double sum = 0.;
+    for (std::size_t i = 0; i < window.size(); ++i) {
+      sum += window[i];
+    }
+    result.min_ms = window.front();
+    result.avg_ms = sum / window.size();
+    result.p99_ms = window[(window.size() * 99 + 99) / 100 - 1];
+    return result;
+  }
+
+  static std::string
+  statsJson(Stats const& s) {
+    return "{ \"min\": " + std::to_string(s.min_ms) +
+           ", \"avg\": " + std::to_string(s.avg_ms) +
+           ", \"p99\": " + std::to_string(s.p99_ms) + " }";
+  }
+
+private: // Member variables.
+  std::vector<Pass> _passes;
+  std::deque<Record> _pending; // In begin() order.
+  std::uint64_t _first_token; // Token of _pending.front().
+  std::vector<GLuint> _pool; // Free queries.
+};
+
+#endif // PASS_PROFILER_HPP_INCLUDED
@@ -0,0 +1,270 @@
+#ifndef PIXEL_READBACK_HPP_INCLUDED
+#define PIXEL_READBACK_HPP_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "GlDebug.hpp"
+
+//! Asynchronous framebuffer readback through a ring of pixel pack buffers.
+//! read() only queues a copy into the next buffer and a fence, so the GPU
+//! keeps rendering the following frames. Once the fence has passed, poll()
+//! maps the buffer and runs the encoder given to read() on it, on a worker
+//! thread, which e.g. writes an image file straight from the mapping; the
+//! buffer is unmapped and reused after the encoder returns. All member
+//! functions must be called from the thread that owns the GL context.
+class PixelReadbackRing {
+public:
+  //! Called on the encoder thread with tightly packed rows. Encoders run
+  //! one at a time, in read() order. A readback whose fence or mapping
+  //! fails is reported on std::cerr and its encoder is not run.
+  typedef std::function<void(void const* pixels)> Encoder;
+
+  explicit
+  PixelReadbackRing(std::size_t const depth)
+    : _slots(depth)
+    , _next(0)
+    , _stop(false) {
+    for (std::size_t s = 0; s < _slots.size(); ++s) {
+      glGenBuffers(1, &_slots[s].buffer);
+    }
+    GL_CHECK("glGenBuffers");
+    _thread = std::thread([this]() { encodeLoop(); });
+  }
+
+  ~PixelReadbackRing() {
+    finish();
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      _stop = true;
+    }
+    _queued.notify_one();
+    _thread.join();
+    for (std::size_t s = 0; s < _slots.size(); ++s) {
+      glDeleteBuffers(1, &_slots[s].buffer);
+    }
+  }
+
+  //! Queues a readback of the current read buffer of the bound read
+  //! framebuffer. Waits only if the next buffer of the ring is still in
+  //! use, i.e. more than depth readbacks are in flight.
+  void
+  read(GLint const x, GLint const y, GLsizei const width,
+       GLsizei const height, GLenum const format, GLenum const type,
+       std::size_t const pixel_size, Encoder const& encoder) {
+    Slot& slot = _slots[_next];
+    waitFree(_next);
+    std::size_t const size = width * height * pixel_size;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (slot.capacity < size) {
+      glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+      GL_CHECK("glBufferData");
+      slot.capacity = size;
+    }
+    GLint alignment = 4;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(x, y, width, height, format, type, nullptr);
+    GL_CHECK("glReadPixels");
+    glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    GL_CHECK("glFenceSync");
+    slot.size = size;
+    slot.encoder = encoder;
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      slot.state = kReading;
+    }
+    _reads.push_back(_next);
+    _next = (_next + 1) % _slots.size();
+  }
+
+  //! Advances readbacks without blocking: passes finished copies to the
+  //! encoder and recycles buffers the encoder is done with.
+  void
+  poll() {
+    while (!_reads.empty() && startEncoding(0)) {
+    }
+    for (std::size_t s = 0; s < _slots.size(); ++s) {
+      recycle(s);
+    }
+  }
+
+  //! True while any readback is copying or encoding.
+  bool
+  busy() const {
+    std::lock_guard<std::mutex> const lock(_mutex);
+    for (std::size_t s = 0; s < _slots.size(); ++s) {
+      if (_slots[s].state != kFree) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //! Blocks until all queued readbacks are encoded.
+  void
+  finish() {
+    for (std::size_t s = 0; s < _slots.size(); ++s) {
+      waitFree(s);
+    }
+  }
+
+private:
+  PixelReadbackRing(PixelReadbackRing const&);
+  PixelReadbackRing& operator=(PixelReadbackRing const&);
+
+  enum State {
+    kFree,
+    kReading,  // Copy into the buffer queued, fence pending.
+    kEncoding, // Mapped, owned by the encoder thread.
+    kEncoded   // Encoder done, waiting to be unmapped.
+  };
+
+  struct Slot {
+    Slot()
+      : buffer(0), capacity(0), size(0), fence(nullptr), pixels(nullptr),
+        state(kFree) {}
+    GLuint buffer;
+    std::size_t capacity;
+    std::size_t size;
+    GLsync fence;
+    Encoder encoder;
+    void const* pixels;
+    State state; // Guarded by _mutex.
+  };
+
+  //! Passes the oldest pending readback to the encoder thread once its
+  //! fence has passed, waiting at most timeout nanoseconds. Only the front
+  //! of _reads is started, which keeps the encoders in read() order.
+  //! Returns false if the fence has not passed yet.
+  bool
+  startEncoding(GLuint64 const timeout) {
+    std::size_t const s = _reads.front();
+    Slot& slot = _slots[s];
+    GLenum const status = glClientWaitSync(
+      slot.fence, timeout > 0 ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeout);
+    if (status == GL_TIMEOUT_EXPIRED) {
+      return false;
+    }
+    _reads.pop_front();
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    if (status == GL_WAIT_FAILED) {
+      drop(s, "glClientWaitSync failed");
+      return true;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    slot.pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size,
+                                   GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GL_CHECK("glMapBufferRange");
+    if (slot.pixels == nullptr) {
+      drop(s, "glMapBufferRange failed");
+      return true;
+    }
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      slot.state = kEncoding;
+      _jobs.push_back(s);
+    }
+    _queued.notify_one();
+    return true;
+  }
+
+  //! Frees slot s without running its encoder.
+  void
+  drop(std::size_t const s, char const* const reason) {
+    std::cerr << "Warning: readback dropped, " << reason << std::endl;
+    _slots[s].encoder = Encoder(); // Release captures.
+    std::lock_guard<std::mutex> const lock(_mutex);
+    _slots[s].state = kFree;
+  }
+
+  //! Unmaps and frees slot s if its encoder is done.
+  void
+  recycle(std::size_t const s) {
+    Slot& slot = _slots[s];
+    {
+      std::lock_guard<std::mutex> const lock(_mutex);
+      if (slot.state != kEncoded) {
+        return;
+      }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.pixels = nullptr;
+    slot.encoder = Encoder(); // Release captures.
+    std::lock_guard<std::mutex> const lock(_mutex);
+    slot.state = kFree;
+  }
+
+  //! Blocks until slot s is free. Starts the readbacks queued before it
+  //! first, so the encoders still run in order.
+  void
+  waitFree(std::size_t const s) {
+    for (;;) {
+      bool reading = false;
+      {
+        std::lock_guard<std::mutex> const lock(_mutex);
+        reading = _slots[s].state == kReading;
+      }
+      if (reading) {
+        startEncoding(GL_TIMEOUT_IGNORED);
+        continue;
+      }
+      recycle(s);
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (_slots[s].state == kFree) {
+        return;
+      }
+      _encoded.wait(lock, [&]() { return _slots[s].state != kEncoding; });
+    }
+  }
+
+  void
+  encodeLoop() {
+    for (;;) {
+      std::size_t s = 0;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _queued.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+        if (_jobs.empty()) {
+          return; // Stopped.
+        }
+        s = _jobs.front();
+        _jobs.pop_front();
+      }
+      Slot const& slot = _slots[s];
+      slot.encoder(slot.pixels);
+      {
+        std::lock_guard<std::mutex> const lock(_mutex);
+        _slots[s].state = kEncoded;
+      }
+      _encoded.notify_all();
+    }
+  }
+
+private: // Member variables.
+  std::vector<Slot> _slots;
+  std::size_t _next;
+  std::thread _thread;
+  mutable std::mutex _mutex;
+  std::condition_variable _queued;
+  std::condition_variable _encoded;
+  std::deque<std::size_t> _reads; // Slots in kReading, in read() order.
+  std::deque<std::size_t> _jobs; // Guarded by _mutex.
+  bool _stop;
+};
+
+#endif // PIXEL_READBACK_HPP_INCLUDED
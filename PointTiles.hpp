@@ -0,0 +1,252 @@
+#ifndef POINT_TILES_HPP_INCLUDED
+#define POINT_TILES_HPP_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "Random.hpp"
+
+//! Poisson disk samples on the unit torus: no two points are closer than
+//! radius when the unit square is repeated in both directions. Repeating
+//! such a tile therefore keeps the minimum distance across tile borders.
+inline std::vector<std::array<float, 2>>
+makePeriodicPoissonTile(float const radius,
+                        std::uint32_t const seed,
+                        std::uint32_t const max_sample_attempts = 30) {
+  using namespace std;
+  typedef array<float, 2> Point;
+
+  // Cell size is at most radius / sqrt(2) and divides the unit square.
+  ptrdiff_t const n = static_cast<ptrdiff_t>(ceil(sqrt(2.f) / radius));
+  float const cell_size = 1.f / n;
+  vector<int> grid(n * n, -1);
+  vector<Point> samples;
+  vector<size_t> active;
+  uint64_t const key = streamKey(seed, kSampleStream);
+  uint64_t counter = 0;
+
+  auto const wrap = [](float const x) { return x - floor(x); };
+  auto const cellOf = [&](float const x) {
+    return min(static_cast<ptrdiff_t>(x / cell_size), n - 1);
+  };
+  auto const isFree = [&](Point const& p) {
+    ptrdiff_t const cx = cellOf(p[0]);
+    ptrdiff_t const cy = cellOf(p[1]);
+    for (ptrdiff_t dy = -2; dy <= 2; ++dy) {
+      for (ptrdiff_t dx = -2; dx <= 2; ++dx) {
+        int const s = grid[((cy + dy + n) % n) * n + (cx + dx + n) % n];
+        if (s >= 0) {
+          float ex = fabs(samples[s][0] - p[0]);
+          float ey = fabs(samples[s][1] - p[1]);
+          ex = min(ex, 1.f - ex);
+          ey = min(ey, 1.f - ey);
+          if (ex * ex + ey * ey < radius * radius) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  };
+  auto const add = [&](Point const& p) {
+    grid[cellOf(p[1]) * n + cellOf(p[0])] = static_cast<int>(samples.size());
+    active.push_back(samples.size());
+    samples.push_back(p);
+  };
+
+  Point const first = {{ uniformFloat(counterHash(key, counter++)),
+                         uniformFloat(counterHash(key, counter++)) }};
+  add(first);
+  while (!active.empty()) {
+    size_t const a = counterHash(key, counter++) % active.size();
+    Point const center = samples[active[a]];
+    bool found = false;
+    for (uint32_t i = 0; i < max_sample_attempts; ++i) {
+      float const r = radius * (1.f + uniformFloat(counterHash(key, counter++)));
+      float const t = 6.2831853f * uniformFloat(counterHash(key, counter++));
+      Point const p = {{ wrap(center[0] + r * cos(t)),
+                         wrap(center[1] + r * sin(t)) }};
+      if (isFree(p)) {
+        add(p);
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      active[a] = active.back();
+      active.pop_back();
+    }
+  }
+  return samples;
+}
+
+//! Set of precomputed periodic blue-noise tiles, stored as a binary file
+//! built offline by the make-point-tiles tool and memory mapped at startup.
+//! Layout: header, tile_count + 1 point offsets, then all points as float
+//! pairs in unit tile coordinates.
+class PointTileSet {
+public:
+  static std::uint32_t const kFormatVersion = 1;
+
+  struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t tile_count;
+    float radius; // Minimum distance in unit tile coordinates.
+    std::uint32_t reserved;
+  };
+
+  explicit
+  PointTileSet(std::string const& filename)
+    : _file(filename)
+    , _header(nullptr)
+    , _offsets(nullptr)
+    , _points(nullptr) {
+    if (!_file.isMapped() || _file.size() < sizeof(Header)) {
+      return;
+    }
+    Header const* header = static_cast<Header const*>(_file.data());
+    if (std::memcmp(header->magic, magic(), sizeof(header->magic)) != 0 ||
+        header->version != kFormatVersion ||
+        header->tile_count == 0) {
+      return;
+    }
+    std::uint64_t const* offsets = reinterpret_cast<std::uint64_t const*>(
+      static_cast<char const*>(_file.data()) + sizeof(Header));
+    std::size_t const points_offset =
+      sizeof(Header) + (header->tile_count + 1) * sizeof(std::uint64_t);
+    if (points_offset > _file.size() ||
+        points_offset + offsets[header->tile_count] * 2 * sizeof(float) >
+          _file.size()) {
+      return; // Truncated file.
+    }
+    _offsets = offsets;
+    _points = reinterpret_cast<float const*>(
+      static_cast<char const*>(_file.data()) + points_offset);
+    _header = header;
+  }
+
+  bool
+  valid() const {
+    return _header != nullptr;
+  }
+
+  std::size_t
+  tileCount() const {
+    return _header->tile_count;
+  }
+
+  float
+  radius() const {
+    return _header->radius;
+  }
+
+  std::size_t
+  pointCount(std::size_t const tile) const {
+    return static_cast<std::size_t>(_offsets[tile + 1] - _offsets[tile]);
+  }
+
+  //! Interleaved x, y pairs of a tile.
+  float const*
+  points(std::size_t const tile) const {
+    return _points + 2 * _offsets[tile];
+  }
+
+  MappedFile const&
+  file() const {
+    return _file;
+  }
+
+  static bool
+  write(std::string const& filename, float const radius,
+        std::vector<std::vector<std::array<float, 2>>> const& tiles) {
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, magic(), sizeof(header.magic));
+    header.version = kFormatVersion;
+    header.tile_count = static_cast<std::uint32_t>(tiles.size());
+    header.radius = radius;
+    std::vector<std::uint64_t> offsets(1, 0);
+    for (std::size_t t = 0; t < tiles.size(); ++t) {
+      offsets.push_back(offsets.back() + tiles[t].size());
+    }
+
+    std::ofstream ofs(filename, std::ios_base::out | std::ios_base::binary |
+                                std::ios_base::trunc);
+    ofs.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<char const*>(offsets.data()),
+              offsets.size() * sizeof(std::uint64_t));
+    for (std::size_t t = 0; t < tiles.size(); ++t) {
+      ofs.write(reinterpret_cast<char const*>(tiles[t].data()),
+                tiles[t].size() * sizeof(std::array<float, 2>));
+    }
+    return static_cast<bool>(ofs);
+  }
+
+private:
+  static char const*
+  magic() {
+    static char const kMagic[8] = { 'Y', 'U', 'V', 'T', 'I', 'L', 'E', '\0' };
+    return kMagic;
+  }
+
+private: // Member variables.
+  MappedFile _file;
+  Header const* _header;
+  std::uint64_t const* _offsets;
+  float const* _points;
+};
+
+//! Covers [x_min, x_max] with copies of one tile of the set, scaled so that
+//! the tile minimum distance becomes radius. The seed picks the tile and a
+//! periodic offset, which keeps the minimum distance. Linear in the number
+//! of output samples.
+inline std::vector<std::array<float, 2>>
+tiledPointSamples(PointTileSet const& tile_set,
+                  float const radius,
+                  std::array<float, 2> const& x_min,
+                  std::array<float, 2> const& x_max,
+                  std::uint32_t const seed) {
+  using namespace std;
+  uint64_t const key = streamKey(seed, kSampleStream);
+  size_t const tile = counterHash(key, 0) % tile_set.tileCount();
+  float const offset_x = uniformFloat(counterHash(key, 1));
+  float const offset_y = uniformFloat(counterHash(key, 2));
+  float const* const points = tile_set.points(tile);
+  size_t const point_count = tile_set.pointCount(tile);
+
+  float const tile_size = radius / tile_set.radius();
+  ptrdiff_t const tiles_x =
+    static_cast<ptrdiff_t>(ceil((x_max[0] - x_min[0]) / tile_size));
+  ptrdiff_t const tiles_y =
+    static_cast<ptrdiff_t>(ceil((x_max[1] - x_min[1]) / tile_size));
+
+  vector<array<float, 2>> samples;
+  samples.reserve(tiles_x * tiles_y * point_count);
+  for (ptrdiff_t ty = 0; ty < tiles_y; ++ty) {
+    for (ptrdiff_t tx = 0; tx < tiles_x; ++tx) {
+      for (size_t i = 0; i < point_count; ++i) {
+        float u = points[2 * i + 0] + offset_x;
+        float v = points[2 * i + 1] + offset_y;
+        u -= u >= 1.f ? 1.f : 0.f;
+        v -= v >= 1.f ? 1.f : 0.f;
+        array<float, 2> const p = {{ x_min[0] + (tx + u) * tile_size,
+                                     x_min[1] + (ty + v) * tile_size }};
+        if (p[0] <= x_max[0] && p[1] <= x_max[1]) {
+          samples.push_back(p);
+        }
+      }
+    }
+  }
+  return samples;
+}
+
+#endif // POINT_TILES_HPP_INCLUDED
@@ -0,0 +1,348 @@
+#ifndef POISSON_SAMPLING_HPP_INCLUDED
+#define POISSON_SAMPLING_HPP_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Parallel.hpp"
+#include "Random.hpp"
+
+namespace detail {
+
+//! Background grid with cell size radius / sqrt(2), so that each cell holds
+//! at most one sample. Positions are stored in the cells directly.
+template <typename T>
+class PoissonGrid {
+public:
+  PoissonGrid(T const radius,
+              std::array<T, 2> const& x_min,
+              std::array<T, 2> const& x_max)
+    : _radius(radius)
+    , _cell_size(radius / std::sqrt(T(2)))
+    , _x_min(x_min) {
+    _size[0] = std::max<std::ptrdiff_t>(
+      1, static_cast<std::ptrdiff_t>(std::ceil((x_max[0] - x_min[0]) / _cell_size)));
+    _size[1] = std::max<std::ptrdiff_t>(
+      1, static_cast<std::ptrdiff_t>(std::ceil((x_max[1] - x_min[1]) / _cell_size)));
+    _occupied.assign(_size[0] * _size[1], 0);
+    _pos.resize(_size[0] * _size[1]);
+  }
+
+  std::ptrdiff_t
+  size(std::size_t const axis) const {
+    return _size[axis];
+  }
+
+  T
+  cellSize() const {
+    return _cell_size;
+  }
+
+  std::array<std::ptrdiff_t, 2>
+  cell(std::array<T, 2> const& p) const {
+    std::array<std::ptrdiff_t, 2> c = {{
+      static_cast<std::ptrdiff_t>((p[0] - _x_min[0]) / _cell_size),
+      static_cast<std::ptrdiff_t>((p[1] - _x_min[1]) / _cell_size) }};
+    c[0] = std::min(std::max<std::ptrdiff_t>(c[0], 0), _size[0] - 1);
+    c[1] = std::min(std::max<std::ptrdiff_t>(c[1], 0), _size[1] - 1);
+    return c;
+  }
+
+  //! True if no stored sample is closer than radius to p.
+  bool
+  isFree(std::array<T, 2> const& p) const {
+    std::array<std::ptrdiff_t, 2> const c = cell(p);
+    std::ptrdiff_t const x0 = std::max<std::ptrdiff_t>(c[0] - 2, 0);
+    std::ptrdiff_t const y0 = std::max<std::ptrdiff_t>(c[1] - 2, 0);
+    std::ptrdiff_t const x1 = std::min<std::ptrdiff_t>(c[0] + 2, _size[0] - 1);
+    std::ptrdiff_t const y1 = std::min<std::ptrdiff_t>(c[1] + 2, _size[1] - 1);
+    T const radius_sq = _radius * _radius;
+    for (std::ptrdiff_t y = y0; y <= y1; ++y) {
+      for (std::ptrdiff_t x = x0; x <= x1; ++x) {
+        std::size_t const i = y * _size[0] + x;
+        if (_occupied[i]) {
+          T const dx = _pos[i][0] - p[0];
+          T const dy = _pos[i][1] - p[1];
+          if (dx * dx + dy * dy < radius_sq) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  void
+  add(std::array<T, 2> const& p) {
+    std::array<std::ptrdiff_t, 2> const c = cell(p);
+    std::size_t const i = c[1] * _size[0] + c[0];
+    _occupied[i] = 1;
+    _pos[i] = p;
+  }
+
+  bool
+  occupied(std::ptrdiff_t const x, std::ptrdiff_t const y) const {
+    return _occupied[y * _size[0] + x] != 0;
+  }
+
+  std::array<T, 2> const&
+  pos(std::ptrdiff_t const x, std::ptrdiff_t const y) const {
+    return _pos[y * _size[0] + x];
+  }
+
+private: // Member variables.
+  T _radius;
+  T _cell_size;
+  std::array<T, 2> _x_min;
+  std::ptrdiff_t _size[2];
+  std::vector<unsigned char> _occupied;
+  std::vector<std::array<T, 2>> _pos;
+};
+
+//! Draws a candidate in the annulus [radius, 2 * radius] around center.
+template <typename T>
+std::array<T, 2>
+annulusSample(std::array<T, 2> const& center, T const radius,
+              std::uint64_t const key, std::uint64_t* counter) {
+  T const r = radius * (1 + uniformFloat(counterHash(key, (*counter)++)));
+  T const a = T(6.28318530717958647692) *
+              uniformFloat(counterHash(key, (*counter)++));
+  std::array<T, 2> const p = {{ center[0] + r * std::cos(a),
+                                center[1] + r * std::sin(a) }};
+  return p;
+}
+
+} // namespace detail
+
+//! Poisson disk sampling in a rectangle using a 2 x 2 phase-grouped tiling.
+//! Tiles several radii wide are processed in four phases; tiles within a
+//! phase never touch each other, so they are sampled concurrently with
+//! Bridson's algorithm against one shared background grid. Tile samples are
+//! seeded from samples already placed in neighboring tiles, which fills the
+//! seams. Every sample is at least radius from all others, and the result
+//! depends only on the arguments, not on the number of threads.
+template <typename T>
+std::vector<std::array<T, 2>>
+tiledPoissonDiskSampling(T const radius,
+                         std::array<T, 2> const& x_min,
+                         std::array<T, 2> const& x_max,
+                         std::uint32_t const max_sample_attempts = 30,
+                         std::uint32_t const seed = 0) {
+  using namespace std;
+  typedef array<T, 2> Point;
+  T const kTileSizeInRadii = 16;
+
+  detail::PoissonGrid<T> grid(radius, x_min, x_max);
+  T const cell_size = grid.cellSize();
+
+  // At least 4 cells per tile, so that the 3 cell neighborhoods read by
+  // tiles running in the same phase never overlap.
+  ptrdiff_t const tile_cells = max<ptrdiff_t>(
+    4, static_cast<ptrdiff_t>(ceil(kTileSizeInRadii * radius / cell_size)));
+  ptrdiff_t const tiles_x = (grid.size(0) + tile_cells - 1) / tile_cells;
+  ptrdiff_t const tiles_y = (grid.size(1) + tile_cells - 1) / tile_cells;
+  vector<vector<Point>> tile_samples(tiles_x * tiles_y);
+
+  auto const sampleTile = [&](ptrdiff_t const tx, ptrdiff_t const ty) {
+    size_t const tile_index = ty * tiles_x + tx;
+    uint64_t const key =
+      streamKey(streamKey(seed, kPoissonTileStream), tile_index);
+    uint64_t counter = 0;
+
+    ptrdiff_t const cx0 = tx * tile_cells;
+    ptrdiff_t const cy0 = ty * tile_cells;
+    ptrdiff_t const cx1 = min(cx0 + tile_cells, grid.size(0));
+    ptrdiff_t const cy1 = min(cy0 + tile_cells, grid.size(1));
+    Point const tile_min = {{ x_min[0] + cx0 * cell_size,
+                              x_min[1] + cy0 * cell_size }};
+    Point const tile_max = {{ min(x_min[0] + cx1 * cell_size, x_max[0]),
+                              min(x_min[1] + cy1 * cell_size, x_max[1]) }};
+    // Tile membership is decided by grid cell, since a tile may only write
+    // to its own cells.
+    auto const inTile = [&](Point const& p) {
+      if (!(x_min[0] <= p[0] && p[0] < x_max[0] &&
+            x_min[1] <= p[1] && p[1] < x_max[1])) {
+        return false;
+      }
+      array<ptrdiff_t, 2> const c = grid.cell(p);
+      return cx0 <= c[0] && c[0] < cx1 && cy0 <= c[1] && c[1] < cy1;
+    };
+
+    // Spawn from samples of earlier phases that can reach into this tile.
+    vector<Point> active;
+    for (ptrdiff_t y = max<ptrdiff_t>(cy0 - 3, 0);
+         y < min(cy1 + 3, grid.size(1)); ++y) {
+      for (ptrdiff_t x = max<ptrdiff_t>(cx0 - 3, 0);
+           x < min(cx1 + 3, grid.size(0)); ++x) {
+        if ((x < cx0 || x >= cx1 || y < cy0 || y >= cy1) &&
+            grid.occupied(x, y)) {
+          active.push_back(grid.pos(x, y));
+        }
+      }
+    }
+
+    vector<Point>& samples = tile_samples[tile_index];
+    for (uint32_t i = 0; i < max_sample_attempts; ++i) {
+      Point const p = {{
+        uniformFloat(key, counter++, tile_min[0], tile_max[0]),
+        uniformFloat(key, counter++, tile_min[1], tile_max[1]) }};
+      if (inTile(p) && grid.isFree(p)) {
+        grid.add(p);
+        samples.push_back(p);
+        active.push_back(p);
+        break;
+      }
+    }
+
+    while (!active.empty()) {
+      size_t const a = static_cast<size_t>(
+        counterHash(key, counter++) % active.size());
+      bool found = false;
+      for (uint32_t i = 0; i < max_sample_attempts; ++i) {
+        Point const p =
+          detail::annulusSample(active[a], radius, key, &counter);
+        if (inTile(p) && grid.isFree(p)) {
+          grid.add(p);
+          samples.push_back(p);
+          active.push_back(p);
+          found = true;
+          break;
+        }
+      }
+      if (!found) {
+        active[a] = active.back();
+        active.pop_back();
+      }
+    }
+  };
+
+  for (ptrdiff_t phase = 0; phase < 4; ++phase) {
+    vector<array<ptrdiff_t, 2>> phase_tiles;
+    for (ptrdiff_t ty = phase / 2; ty < tiles_y; ty += 2) {
+      for (ptrdiff_t tx = phase % 2; tx < tiles_x; tx += 2) {
+        array<ptrdiff_t, 2> const t = {{ tx, ty }};
+        phase_tiles.push_back(t);
+      }
+    }
+    parallelFor(phase_tiles.size(), 1, [&](size_t const begin, size_t const end) {
+      for (size_t i = begin; i < end; ++i) {
+        sampleTile(phase_tiles[i][0], phase_tiles[i][1]);
+      }
+    });
+  }
+
+  vector<Point> samples;
+  for (size_t t = 0; t < tile_samples.size(); ++t) {
+    samples.insert(samples.end(), tile_samples[t].begin(), tile_samples[t].end());
+  }
+  return samples;
+}
+
+//! Poisson disk sampling where the minimum distance varies over the domain.
+//! radius_fn(p) gives the local radius, clamped to [radius_min, radius_max].
+//! Two samples p and q are at least max(radius_fn(p), radius_fn(q)) apart.
+//! Serial Bridson over a grid sized for radius_min; the neighborhood search
+//! widens to cover radius_max.
+template <typename T, typename RadiusFn>
+std::vector<std::array<T, 2>>
+variablePoissonDiskSampling(RadiusFn radius_fn,
+                            T const radius_min,
+                            T const radius_max,
+                            std::array<T, 2> const& x_min,
+                            std::array<T, 2> const& x_max,
+                            std::uint32_t const max_sample_attempts = 30,
+                            std::uint32_t const seed = 0) {
+  using namespace std;
+  typedef array<T, 2> Point;
+
+  T const cell_size = radius_min / sqrt(T(2));
+  ptrdiff_t const gx = max<ptrdiff_t>(
+    1, static_cast<ptrdiff_t>(ceil((x_max[0] - x_min[0]) / cell_size)));
+  ptrdiff_t const gy = max<ptrdiff_t>(
+    1, static_cast<ptrdiff_t>(ceil((x_max[1] - x_min[1]) / cell_size)));
+  ptrdiff_t const reach = static_cast<ptrdiff_t>(ceil(radius_max / cell_size));
+  vector<int> grid(gx * gy, -1);
+  vector<Point> samples;
+  vector<T> sample_radius;
+  vector<size_t> active;
+  uint64_t const key = streamKey(seed, kSampleStream);
+  uint64_t counter = 0;
+
+  auto const radiusAt = [&](Point const& p) {
+    return min(max(static_cast<T>(radius_fn(p)), radius_min), radius_max);
+  };
+  auto const cellOf = [&](Point const& p) {
+    array<ptrdiff_t, 2> c = {{
+      static_cast<ptrdiff_t>((p[0] - x_min[0]) / cell_size),
+      static_cast<ptrdiff_t>((p[1] - x_min[1]) / cell_size) }};
+    c[0] = min(max<ptrdiff_t>(c[0], 0), gx - 1);
+    c[1] = min(max<ptrdiff_t>(c[1], 0), gy - 1);
+    return c;
+  };
+  auto const isFree = [&](Point const& p, T const r) {
+    array<ptrdiff_t, 2> const c = cellOf(p);
+    for (ptrdiff_t y = max<ptrdiff_t>(c[1] - reach, 0);
+         y <= min(c[1] + reach, gy - 1); ++y) {
+      for (ptrdiff_t x = max<ptrdiff_t>(c[0] - reach, 0);
+           x <= min(c[0] + reach, gx - 1); ++x) {
+        int const s = grid[y * gx + x];
+        if (s >= 0) {
+          T const d = max(r, sample_radius[s]);
+          T const dx = samples[s][0] - p[0];
+          T const dy = samples[s][1] - p[1];
+          if (dx * dx + dy * dy < d * d) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  };
+  auto const add = [&](Point const& p, T const r) {
+    array<ptrdiff_t, 2> const c = cellOf(p);
+    grid[c[1] * gx + c[0]] = static_cast<int>(samples.size());
+    active.push_back(samples.size());
+    samples.push_back(p);
+    sample_radius.push_back(r);
+  };
+  auto const inside = [&](Point const& p) {
+    return x_min[0] <= p[0] && p[0] < x_max[0] &&
+           x_min[1] <= p[1] && p[1] < x_max[1];
+  };
+
+  Point const first = {{
+    uniformFloat(key, counter++, x_min[0], x_max[0]),
+    uniformFloat(key, counter++, x_min[1], x_max[1]) }};
+  add(first, radiusAt(first));
+  while (!active.empty()) {
+    size_t const a = static_cast<size_t>(
+      counterHash(key, counter++) % active.size());
+    Point const center = samples[active[a]];
+    T const center_radius = sample_radius[active[a]];
+    bool found = false;
+    for (uint32_t i = 0; i < max_sample_attempts; ++i) {
+      Point const p =
+        detail::annulusSample(center, center_radius, key, &counter);
+      if (!inside(p)) {
+        continue;
+      }
+      T const r = radiusAt(p);
+      if (isFree(p, r)) {
+        add(p, r);
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      active[a] = active.back();
+      active.pop_back();
+    }
+  }
+  return samples;
+}
+
+#endif // POISSON_SAMPLING_HPP_INCLUDED
@@ -0,0 +1,54 @@
+#ifndef RANDOM_HPP_INCLUDED
+#define RANDOM_HPP_INCLUDED
+
+#include <cstdint>
+
+// Counter-based random numbers. A value is a pure function of a key and a
+// counter, so any subset of a sequence can be generated independently and in
+// any order, e.g. in parallel chunks, with bit-identical results.
+
+//! splitmix64 finalizer.
+inline std::uint64_t
+mix64(std::uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+//! Returns the counter:th output of a splitmix64 sequence seeded with key.
+inline std::uint64_t
+counterHash(std::uint64_t const key, std::uint64_t const counter) {
+  return mix64(key + (counter + 1) * 0x9e3779b97f4a7c15ULL);
+}
+
+// Stream ids for streamKey(), one per use of a seed, so that no two uses
+// draw the same numbers. Uses that need many streams nest them under
+// their own id, e.g. streamKey(streamKey(seed, kPoissonTileStream), tile).
+std::uint64_t const kSampleStream = 0; // Sample positions and jitter.
+std::uint64_t const kZOffsetStream = 1; // Vertex z offsets.
+std::uint64_t const kPyramidStream = 2; // Mesh pyramid priorities.
+std::uint64_t const kPoissonTileStream = 3; // Per-tile Poisson candidates.
+
+//! Derives independent keys for different uses of the same seed.
+inline std::uint64_t
+streamKey(std::uint64_t const seed, std::uint64_t const stream) {
+  return mix64(mix64(seed) ^ (stream * 0xd1342543de82ef95ULL));
+}
+
+//! Uniform float in [0, 1) from the high 24 bits.
+inline float
+uniformFloat(std::uint64_t const bits) {
+  return static_cast<float>(bits >> 40) * (1.f / 16777216.f);
+}
+
+//! Uniform float in [a, b) for the counter:th element of a stream.
+inline float
+uniformFloat(std::uint64_t const key, std::uint64_t const counter,
+             float const a, float const b) {
+  return a + (b - a) * uniformFloat(counterHash(key, counter));
+}
+
+#endif // RANDOM_HPP_INCLUDED
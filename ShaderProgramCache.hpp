@@ -0,0 +1,374 @@
+#ifndef SHADER_PROGRAM_CACHE_HPP_INCLUDED
+#define SHADER_PROGRAM_CACHE_HPP_INCLUDED
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <GL/glew.h>
+
+#include "MeshCache.hpp" // hashBytes().
+
+//! One shader stage of a CachedShaderProgram.
+struct ShaderSource {
+  GLenum type; // E.g. GL_VERTEX_SHADER.
+  std::string source;
+};
+
+//! Linked shader program that is stored in an on-disk binary cache. The
+//! cache file is keyed by the shader sources and the GL vendor, renderer
+//! and version strings. On a hit the program is created with
+//! glProgramBinary; on a miss, or if the driver rejects the binary, it is
+//! compiled from source and the binary written back with
+//! glGetProgramBinary. Mirrors the parts of ndj::ShaderProgram that are
+//! used with Bindor. Throws std::runtime_error on compile or link errors.
+class CachedShaderProgram {
+public:
+  struct Attrib {
+    GLint location;
+  };
+
+  class UniformBlock {
+  public:
+    UniformBlock(GLuint const program, GLuint const index, GLint const size)
+      : _program(program), _index(index), _size(size) {}
+
+    void
+    bind(GLuint const binding) const {
+      glUniformBlockBinding(_program, _index, binding);
+    }
+
+    GLuint
+    binding() const {
+      GLint binding = 0;
+      glGetActiveUniformBlockiv(_program, _index, GL_UNIFORM_BLOCK_BINDING,
+                                &binding);
+      return static_cast<GLuint>(binding);
+    }
+
+    GLint
+    size() const {
+      return _size;
+    }
+
+  private: // Member variables.
+    GLuint _program;
+    GLuint _index;
+    GLint _size;
+  };
+
+  CachedShaderProgram(std::vector<ShaderSource> const& sources,
+                      std::string const& cache_directory)
+    : _handle(glCreateProgram())
+    , _from_cache(false) {
+    std::uint64_t key = hashString(glString(GL_VENDOR));
+    key = hashString(glString(GL_RENDERER), key);
+    key = hashString(glString(GL_VERSION), key);
+    for (std::size_t s = 0; s < sources.size(); ++s) {
+      key = hashValue(sources[s].type, key);
+      key = hashString(sources[s].source, key);
+    }
+    std::string const filename = cacheFilename(cache_directory, key);
+
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    bool const binaries = format_count > 0;
+    _from_cache = binaries && loadBinary(filename, key);
+    if (!_from_cache) {
+      compileAndLink(sources, binaries);
+      if (binaries) {
+        storeBinary(filename, key);
+      }
+    }
+    queryActiveResources();
+  }
+
+  ~CachedShaderProgram() {
+    glDeleteProgram(_handle);
+  }
+
+  GLuint
+  handle() const {
+    return _handle;
+  }
+
+  void
+  bind() const {
+    glUseProgram(_handle);
+  }
+
+  void
+  release() const {
+    glUseProgram(0);
+  }
+
+  //! True if the program was created from a cached binary.
+  bool
+  fromCache() const {
+    return _from_cache;
+  }
+
+  Attrib const&
+  activeAttrib(std::string const& name) const {
+    Attrib const* attrib = queryActiveAttrib(name);
+    if (attrib == nullptr) {
+      throw std::runtime_error("inactive attribute " + name);
+    }
+    return *attrib;
+  }
+
+  //! Null if the program has no active attribute called name.
+  Attrib const*
+  queryActiveAttrib(std::string const& name) const {
+    std::map<std::string, Attrib>::const_iterator const iter =
+      _attribs.find(name);
+    return iter != _attribs.end() ? &iter->second : nullptr;
+  }
+
+  UniformBlock const&
+  activeUniformBlock(std::string const& name) const {
+    std::map<std::string, UniformBlock>::const_iterator const iter =
+      _uniform_blocks.find(name);
+    if (iter == _uniform_blocks.end()) {
+      throw std::runtime_error("inactive uniform block " + name);
+    }
+    return iter->second;
+  }
+
+  friend std::ostream&
+  operator<<(std::ostream& os, CachedShaderProgram const& program) {
+    os << "  handle: " << program._handle
+       << (program._from_cache ? " (binary cache)" : " (compiled)") << "\n";
+    for (std::map<std::string, Attrib>::const_iterator iter =
+           program._attribs.begin(); iter != program._attribs.end(); ++iter) {
+      os << "  attrib " << iter->first << ": location "
+         << iter->second.location << "\n";
+    }
+    for (std::map<std::string, UniformBlock>::const_iterator iter =
+           program._uniform_blocks.begin();
+         iter != program._uniform_blocks.end(); ++iter) {
+      os << "  uniform block " << iter->first << ": " << iter->second.size()
+         << " bytes\n";
+    }
+    return os;
+  }
+
+private:
+  CachedShaderProgram(CachedShaderProgram const&);
+  CachedShaderProgram& operator=(CachedShaderProgram const&);
+
+  struct FileHeader {
+    char magic[8];
+    std::uint64_t key;
+    std::uint32_t format; // Binary format from glGetProgramBinary.
+    std::uint32_t size;
+  };
+
+  static std::string
+  glString(GLenum const name) {
+    GLubyte const* str = glGetString(name);
+    return str != nullptr ? reinterpret_cast<char const*>(str) : "";
+  }
+
+  static std::uint64_t
+  hashString(std::string const& str,
+             std::uint64_t const hash = 14695981039346656037ULL) {
+    return hashBytes(str.data(), str.size(), hash);
+  }
+
+  static char const*
+  magic() {
+    static char const kMagic[8] = { 'Y', 'U', 'V', 'P', 'R', 'O', 'G', '\0' };
+    return kMagic;
+  }
+
+  static std::string
+  cacheFilename(std::string const& directory, std::uint64_t const key) {
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+    char name[64];
+    std::snprintf(name, sizeof(name), "/program-%016llx.bin",
+                  static_cast<unsigned long long>(key));
+    return directory + name;
+  }
+
+  //! False if there is no valid cache file or the driver rejects it, in
+  //! which case the program is left unlinked.
+  bool
+  loadBinary(std::string const& filename, std::uint64_t const key) {
+    std::ifstream ifs(filename, std::ios_base::in | std::ios_base::binary);
+    FileHeader header;
+    if (!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, magic(), sizeof(header.magic)) != 0 ||
+        header.key != key) {
+      return false;
+    }
+    std::vector<char> binary(header.size);
+    if (!ifs.read(binary.data(), binary.size())) {
+      return false;
+    }
+    glProgramBinary(_handle, header.format, binary.data(),
+                    static_cast<GLsizei>(binary.size()));
+    GLint status = GL_FALSE;
+    glGetProgramiv(_handle, GL_LINK_STATUS, &status);
+    while (glGetError() != GL_NO_ERROR) {} // Unsupported format.
+    if (status != GL_TRUE) {
+      glDeleteProgram(_handle); // Start over with a fresh program.
+      _handle = glCreateProgram();
+      return false;
+    }
+    return true;
+  }
+
+  //! Writes through a temporary file, see MeshCacheFile::write(). A
+  //! failed write only costs a compile on the next run.
+  void
+  storeBinary(std::string const& filename, std::uint64_t const key) const {
+    GLint length = 0;
+    glGetProgramiv(_handle, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+      return;
+    }
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(_handle, length, &length, &format, binary.data());
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, magic(), sizeof(header.magic));
+    header.key = key;
+    header.format = format;
+    header.size = static_cast<std::uint32_t>(length);
+
+    std::string const tmp_filename = filename + ".tmp";
+    {
+      std::ofstream ofs(tmp_filename,
+                        std::ios_base::out | std::ios_base::binary |
+                        std::ios_base::trunc);
+      ofs.write(reinterpret_cast<char const*>(&header), sizeof(header));
+      ofs.write(binary.data(), length);
+      if (!ofs) {
+        ofs.close();
+        std::remove(tmp_filename.c_str());
+        return;
+      }
+    }
+    std::remove(filename.c_str()); // rename() does not replace on Windows.
+    std::rename(tmp_filename.c_str(), filename.c_str());
+  }
+
+  void
+  compileAndLink(std::vector<ShaderSource> const& sources,
+                 bool const retrievable) {
+    std::vector<GLuint> shaders;
+    for (std::size_t s = 0; s < sources.size(); ++s) {
+      GLuint const shader = glCreateShader(sources[s].type);
+      char const* source = sources[s].source.c_str();
+      glShaderSource(shader, 1, &source, nullptr);
+      glCompileShader(shader);
+      GLint status = GL_FALSE;
+      glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+      if (status != GL_TRUE) {
+        std::string const log = shaderInfoLog(shader);
+        glDeleteShader(shader);
+        for (std::size_t t = 0; t < shaders.size(); ++t) {
+          glDeleteShader(shaders[t]);
+        }
+        glDeleteProgram(_handle);
+        throw std::runtime_error("shader compile error: " + log);
+      }
+      glAttachShader(_handle, shader);
+      shaders.push_back(shader);
+    }
+    if (retrievable) {
+      glProgramParameteri(_handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                          GL_TRUE);
+    }
+    glLinkProgram(_handle);
+    for (std::size_t s = 0; s < shaders.size(); ++s) {
+      glDetachShader(_handle, shaders[s]);
+      glDeleteShader(shaders[s]);
+    }
+    GLint status = GL_FALSE;
+    glGetProgramiv(_handle, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+      std::string const log = programInfoLog();
+      glDeleteProgram(_handle);
+      throw std::runtime_error("program link error: " + log);
+    }
+  }
+
+  static std::string
+  shaderInfoLog(GLuint const shader) {
+    GLint length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::vector<char> log(length + 1, '\0');
+    glGetShaderInfoLog(shader, length, nullptr, log.data());
+    return log.data();
+  }
+
+  std::string
+  programInfoLog() const {
+    GLint length = 0;
+    glGetProgramiv(_handle, GL_INFO_LOG_LENGTH, &length);
+    std::vector<char> log(length + 1, '\0');
+    glGetProgramInfoLog(_handle, length, nullptr, log.data());
+    return log.data();
+  }
+
+  void
+  queryActiveResources() {
+    GLint count = 0;
+    GLint max_length = 0;
+    glGetProgramiv(_handle, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(_handle, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+    std::vector<char> name(max_length + 1, '\0');
+    for (GLint a = 0; a < count; ++a) {
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveAttrib(_handle, a, static_cast<GLsizei>(name.size()),
+                        nullptr, &size, &type, name.data());
+      Attrib const attrib = { glGetAttribLocation(_handle, name.data()) };
+      if (attrib.location >= 0) { // Skips built-ins like gl_VertexID.
+        _attribs.insert(std::make_pair(std::string(name.data()), attrib));
+      }
+    }
+
+    glGetProgramiv(_handle, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(_handle, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                   &max_length);
+    name.assign(max_length + 1, '\0');
+    for (GLint b = 0; b < count; ++b) {
+      glGetActiveUniformBlockName(_handle, b,
+                                  static_cast<GLsizei>(name.size()), nullptr,
+                                  name.data());
+      GLint size = 0;
+      glGetActiveUniformBlockiv(_handle, b, GL_UNIFORM_BLOCK_DATA_SIZE,
+                                &size);
+      _uniform_blocks.insert(std::make_pair(
+        std::string(name.data()), UniformBlock(_handle, b, size)));
+    }
+  }
+
+private: // Member variables.
+  GLuint _handle;
+  bool _from_cache;
+  std::map<std::string, Attrib> _attribs;
+  std::map<std::string, UniformBlock> _uniform_blocks;
+};
+
+#endif // SHADER_PROGRAM_CACHE_HPP_INCLUDED
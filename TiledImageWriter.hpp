@@ -0,0 +1,86 @@
+#ifndef TILED_IMAGE_WRITER_HPP_INCLUDED
+#define TILED_IMAGE_WRITER_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+//! Binary PPM (P6) file written tile by tile, in any order. The file is
+//! sized up front, then every tile row is written at its final offset, so
+//! only the tile being written needs to be in memory.
+class TiledPpmWriter {
+public:
+  TiledPpmWriter(std::string const& filename,
+                 std::size_t const width,
+                 std::size_t const height)
+    : _ofs(filename, std::ios_base::out | std::ios_base::binary |
+                     std::ios_base::trunc)
+    , _width(width)
+    , _height(height)
+    , _pixels_offset(0) {
+    if (!_ofs) {
+      throw std::runtime_error("cannot open " + filename);
+    }
+    std::ostringstream header;
+    header << "P6\n" << width << " " << height << "\n" << 255 << "\n";
+    std::string const header_str = header.str();
+    _ofs.write(header_str.data(), header_str.size());
+    _pixels_offset = header_str.size();
+
+    // Size the file by writing its last byte.
+    std::uint64_t const size = _pixels_offset + kPixelSize * width * height;
+    if (size > _pixels_offset) {
+      _ofs.seekp(static_cast<std::streamoff>(size - 1));
+      _ofs.put('\0');
+    }
+  }
+
+  //! Writes a width x height tile with tightly packed RGB rows at x, y.
+  //! Rows are written in the given order, top row of the file first.
+  void
+  writeTile(std::size_t const x, std::size_t const y,
+            std::size_t const width, std::size_t const height,
+            void const* pixels) {
+    char const* row = static_cast<char const*>(pixels);
+    std::size_t const row_size = kPixelSize * width;
+    for (std::size_t r = 0; r < height; ++r, row += row_size) {
+      std::uint64_t const offset =
+        _pixels_offset + kPixelSize * ((y + r) * _width + x);
+      _ofs.seekp(static_cast<std::streamoff>(offset));
+      _ofs.write(row, row_size);
+    }
+  }
+
+  //! False if any write failed.
+  bool
+  good() const {
+    return static_cast<bool>(_ofs);
+  }
+
+  std::size_t
+  width() const {
+    return _width;
+  }
+
+  std::size_t
+  height() const {
+    return _height;
+  }
+
+private:
+  static std::size_t const kPixelSize = 3;
+
+  TiledPpmWriter(TiledPpmWriter const&);
+  TiledPpmWriter& operator=(TiledPpmWriter const&);
+
+private: // Member variables.
+  std::ofstream _ofs;
+  std::size_t _width;
+  std::size_t _height;
+  std::uint64_t _pixels_offset;
+};
+
+#endif // TILED_IMAGE_WRITER_HPP_INCLUDED
@@ -0,0 +1,104 @@
+#ifndef TRIANGULATE_HPP_INCLUDED
+#define TRIANGULATE_HPP_INCLUDED
+
+#include <cassert>
+#include <cstdlib>
+#include <vector>
+
+#include "triangle/triangle.h"
+
+//! Delaunay triangulation of pos using Triangle. Point needs operator[] for
+//! x and y, Tri needs i, j and k index members.
+template <typename Point, typename Tri>
+void triangulate(const std::vector<Point>& pos, std::vector<Tri>* tri_index)
+{
+  using namespace std;
+  triangulateio triangulate_in;
+  triangulate_in.pointlist = reinterpret_cast<REAL*>(
+    malloc(pos.size() * 2 * sizeof(REAL)));
+  triangulate_in.pointattributelist = nullptr;
+  triangulate_in.pointmarkerlist = nullptr;
+  triangulate_in.numberofpoints = static_cast<int>(pos.size());
+  triangulate_in.numberofpointattributes = 0;
+  triangulate_in.trianglelist = nullptr;
+  triangulate_in.triangleattributelist = nullptr;
+  triangulate_in.trianglearealist = nullptr;
+  triangulate_in.numberoftriangles = 0;
+  triangulate_in.numberofcorners = 0;
+  triangulate_in.numberoftriangleattributes = 0;
+  triangulate_in.segmentlist = nullptr;
+  triangulate_in.segmentmarkerlist = nullptr;
+  triangulate_in.numberofsegments = 0;
+  triangulate_in.holelist = nullptr;
+  triangulate_in.numberofholes = 0;
+  triangulate_in.regionlist = nullptr;
+  triangulate_in.numberofregions = 0;
+
+  for (size_t i = 0; i < pos.size(); ++i) {
+    triangulate_in.pointlist[i * 2 + 0] = pos[i][0];
+    triangulate_in.pointlist[i * 2 + 1] = pos[i][1];
+  }
+
+  triangulateio triangulate_out;
+  triangulate_out.pointlist = nullptr; // Not needed if -N switch used.
+  triangulate_out.pointattributelist = nullptr; // Not needed if -N switch used or number of point attributes is zero.
+  triangulate_out.pointmarkerlist = nullptr; // Not needed if -N or -B switch used.
+  triangulate_out.trianglelist = nullptr; // Not needed if -E switch used.
+  triangulate_out.triangleattributelist = nullptr; // Not needed if -E switch used or number of triangle attributes is zero.
+  triangulate_out.neighborlist = nullptr; // Needed only if -n switch used.
+  triangulate_out.segmentlist = nullptr; // Needed only if segments are output (-p or -c) and -P not used:
+  triangulate_out.segmentmarkerlist = nullptr;   // Needed only if segments are output (-p or -c) and -P and -B not used:
+  triangulate_out.edgelist = nullptr; // Needed only if -e switch used.
+  triangulate_out.edgemarkerlist = nullptr; // Needed if -e used and -B not used.
+  triangulate_out.normlist = nullptr;
+
+  vector<char> triangulate_flags;
+  triangulate_flags.push_back('P'); // Suppresses the output .poly file.
+  triangulate_flags.push_back('N'); // Suppresses the output .node file.
+  //triangulate_flags.push_back('E'); // Suppresses the output .ele file.
+  triangulate_flags.push_back('c');
+  triangulate_flags.push_back('Q'); // Quiet.
+  triangulate_flags.push_back('z'); // Zero-based indexing.
+  triangulate_flags.push_back('\0'); // Null-termination.
+
+  triangulate(
+    triangulate_flags.data(),
+    &triangulate_in,
+    &triangulate_out,
+    nullptr);
+
+  assert(tri_index != nullptr);
+  tri_index->clear();
+  tri_index->resize(triangulate_out.numberoftriangles);
+  assert(triangulate_out.numberofcorners == 3);
+  for (int t = 0; t < triangulate_out.numberoftriangles; ++t) {
+    (*tri_index)[t].i = triangulate_out.trianglelist[3 * t + 0];
+    (*tri_index)[t].j = triangulate_out.trianglelist[3 * t + 1];
+    (*tri_index)[t].k = triangulate_out.trianglelist[3 * t + 2];
+  }
+
+  // Free all allocated arrays, including those allocated by Triangle.
+  free(triangulate_in.pointlist);
+  free(triangulate_out.pointlist);
+  free(triangulate_in.pointattributelist);
+  free(triangulate_out.pointattributelist);
+  free(triangulate_in.pointmarkerlist);
+  free(triangulate_out.pointmarkerlist);
+  free(triangulate_in.trianglelist);
+  free(triangulate_out.trianglelist);
+  free(triangulate_in.triangleattributelist);
+  free(triangulate_out.triangleattributelist);
+  free(triangulate_in.trianglearealist); // In only.
+  free(triangulate_out.neighborlist); // Out only.
+  free(triangulate_in.segmentlist);
+  free(triangulate_out.segmentlist);
+  free(triangulate_in.segmentmarkerlist);
+  free(triangulate_out.segmentmarkerlist);
+  free(triangulate_in.holelist); // In only.
+  free(triangulate_in.regionlist); // In only.
+  free(triangulate_out.edgelist); // Out only.
+  free(triangulate_out.edgemarkerlist); // Out only.
+  free(triangulate_out.normlist); // Out only.
+}
+
+#endif // TRIANGULATE_HPP_INCLUDED
@@ -0,0 +1,180 @@
+#ifndef UNIFORM_ARENA_HPP_INCLUDED
+#define UNIFORM_ARENA_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "GlDebug.hpp"
+
+//! All uniform blocks in one persistently mapped buffer. Blocks are
+//! sub-allocated at GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT and bound with
+//! glBindBufferRange. The buffer holds region_count copies (regions) of all
+//! blocks; draws read the current region. nextRegion() fences the current
+//! region and moves on to the next one, carrying the block contents over,
+//! so blocks can be rewritten while earlier draws still read the old
+//! values, without glBufferSubData. Without GL 4.4 or ARB_buffer_storage
+//! the regions live in a CPU copy instead and writes are uploaded with
+//! glBufferSubData, which the driver orders against earlier draws.
+class UniformArena {
+public:
+  struct Block {
+    std::size_t offset; // From the start of a region.
+    std::size_t size;
+  };
+
+  UniformArena(std::size_t const capacity, std::size_t const region_count)
+    : _buffer(0)
+    , _data(nullptr)
+    , _alignment(0)
+    , _region_size(0)
+    , _used(0)
+    , _region(0)
+    , _persistent(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+    , _fences(region_count, nullptr) {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    _alignment = static_cast<std::size_t>(alignment);
+    _region_size = alignUp(capacity);
+
+    GLbitfield const flags =
+      GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    std::size_t const size = _region_size * region_count;
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    if (_persistent) {
+      glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+      _data = static_cast<unsigned char*>(
+        glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+    }
+    else {
+      glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+      _shadow.resize(size);
+      _data = _shadow.data();
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GL_CHECK("UniformArena");
+  }
+
+  ~UniformArena() {
+    for (std::size_t r = 0; r < _fences.size(); ++r) {
+      glDeleteSync(_fences[r]);
+    }
+    if (_persistent) {
+      glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+      glUnmapBuffer(GL_UNIFORM_BUFFER);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &_buffer);
+  }
+
+  //! Reserves size bytes in every region. Throws if capacity is exceeded.
+  Block
+  allocate(std::size_t const size) {
+    Block const block = { _used, size };
+    if (_used + size > _region_size) {
+      throw std::runtime_error("uniform arena full");
+    }
+    _used += alignUp(size);
+    return block;
+  }
+
+  //! Copies block.size bytes into the block in the current region. Draws
+  //! issued since the last nextRegion() see the new values too.
+  void
+  write(Block const& block, void const* data) {
+    std::size_t const offset = _region * _region_size + block.offset;
+    std::memcpy(_data + offset, data, block.size);
+    upload(offset, block.size);
+  }
+
+  //! Binds the block to an indexed uniform buffer binding point, and
+  //! rebinds it whenever the region changes.
+  void
+  bind(GLuint const binding, Block const& block) {
+    for (std::size_t b = 0; b < _bindings.size(); ++b) {
+      if (_bindings[b].first == binding) {
+        _bindings[b].second = block;
+        bindRange(binding, block);
+        return;
+      }
+    }
+    _bindings.push_back(std::make_pair(binding, block));
+    bindRange(binding, block);
+  }
+
+  //! Fences the current region and switches to the next one, waiting only
+  //! if the GPU is still reading it, i.e. more than region_count - 1
+  //! regions are in flight.
+  void
+  nextRegion() {
+    std::size_t const previous = _region;
+    _region = (_region + 1) % _fences.size();
+    if (_persistent) {
+      glDeleteSync(_fences[previous]);
+      _fences[previous] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    if (_fences[_region] != nullptr) {
+      GLenum status = GL_TIMEOUT_EXPIRED;
+      while (status == GL_TIMEOUT_EXPIRED) {
+        status = glClientWaitSync(_fences[_region], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                  1000000000); // 1 s.
+      }
+      glDeleteSync(_fences[_region]);
+      _fences[_region] = nullptr;
+    }
+    std::memcpy(_data + _region * _region_size,
+                _data + previous * _region_size, _used);
+    upload(_region * _region_size, _used);
+    for (std::size_t b = 0; b < _bindings.size(); ++b) {
+      bindRange(_bindings[b].first, _bindings[b].second);
+    }
+    GL_CHECK("UniformArena::nextRegion");
+  }
+
+private:
+  UniformArena(UniformArena const&);
+  UniformArena& operator=(UniformArena const&);
+
+  std::size_t
+  alignUp(std::size_t const size) const {
+    return (size + _alignment - 1) / _alignment * _alignment;
+  }
+
+  //! Copies a changed range of the CPU copy to the buffer, if there is
+  //! one. Persistent mappings are coherent and need no upload.
+  void
+  upload(std::size_t const offset, std::size_t const size) {
+    if (_persistent || size == 0) {
+      return;
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, offset, size, _data + offset);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  void
+  bindRange(GLuint const binding, Block const& block) {
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, _buffer,
+                      _region * _region_size + block.offset, block.size);
+  }
+
+private: // Member variables.
+  GLuint _buffer;
+  unsigned char* _data;
+  std::size_t _alignment;
+  std::size_t _region_size;
+  std::size_t _used;
+  std::size_t _region;
+  bool _persistent; // Mapped with glBufferStorage, else _shadow.
+  std::vector<unsigned char> _shadow; // CPU copy of the regions.
+  std::vector<GLsync> _fences; // Only used when _persistent.
+  std::vector<std::pair<GLuint, Block>> _bindings;
+};
+
+#endif // UNIFORM_ARENA_HPP_INCLUDED
@@ -1,24 +1,50 @@
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <exception>
 #include <fstream>
+#include <future>
 #include <iostream>
-#include <random>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <thread>
 #include <vector>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <nDjinn.hpp>
 #include <thx.hpp>
-#include <thinks/poissonDiskSampling.hpp>
 
-#include "triangle/triangle.h"
+#ifndef _WIN32
+#include "EglContext.hpp"
+#endif
+#include "GlDebug.hpp"
+#include "GlStateCache.hpp"
+#include "MeshCache.hpp"
+#include "LatticeMesh.hpp"
+#include "MeshPyramid.hpp"
+#include "Parallel.hpp"
+#include "PassProfiler.hpp"
+#include "PixelReadback.hpp"
+#include "PointTiles.hpp"
+#include "PoissonSampling.hpp"
+#include "Random.hpp"
+#include "ShaderProgramCache.hpp"
+#include "TiledImageWriter.hpp"
+#include "Triangulate.hpp"
+#include "UniformArena.hpp"
 
 using namespace std;
 using namespace ndj;
 using namespace thx;
 
 GLFWwindow* win = nullptr;
+#ifndef _WIN32
+unique_ptr<EglContext> egl_context; // Replaces win in headless mode.
+#endif
 int win_width = 480;
 int win_height = 480;
 
@@ -27,22 +53,78 @@ GLsizei const kMaxFboHeight = 512;//8192;
 GLsizei fbo_width = 0;
 GLsizei fbo_height = 0;
 
-unique_ptr<ShaderProgram> phong_yuv;
+// Out of date render results. scene_dirty: the FBO no longer matches the
+// mesh or uniform buffers. screen_dirty: the window does not show the FBO.
+bool scene_dirty = true;
+bool screen_dirty = true;
+bool gbuffer_dirty = true; // G-buffer does not match the mesh.
+
+const char* const kMeshCacheDirectory = "mesh_cache";
+const char* const kShaderCacheDirectory = "shader_cache";
+const char* const kPointTilesFilename = "point_tiles.bin";
+const size_t kMeshChunkSize = 16384; // Vertices per parallel work item.
+const size_t kMeshUploadBytesPerFrame = 8 << 20;
+const GLfloat kMinSpacingPixels = 8.f; // Finest mesh level drawn.
+const size_t kReadbackRingDepth = 3; // Readbacks in flight.
+const size_t kTileReadbackDepth = 2; // Tiles in memory when tiling.
+const size_t kUniformArenaCapacity = 4096; // Bytes per region.
+const size_t kUniformArenaRegions = 3; // Uniform updates in flight.
+const double kProfileReportMs = 5000.; // Interval of --profile reports.
+const GLfloat kAnimationKeysPerSecond = 1.f; // Vertex noise frequency.
+const GLfloat kCaptureFps = 30.f; // Animation time step of --capture.
+const GLsizei kRasterTileSize = 16; // kTileSize of raster_common.glsl.
+const GLfloat kComputeRasterMaxArea = 4.f; // Mean triangle pixels, --raster.
+
+// Scene bounds: x_min, x_max, y_min, y_max, z_min, z_max.
+array<GLfloat, 6> scene_extent;
+
+unique_ptr<CachedShaderProgram> phong_yuv;
 unique_ptr<VertexArray> phong_yuv_va;
-unique_ptr<UniformBuffer> camera_ubo;
-unique_ptr<UniformBuffer> light_color_ubo;
-unique_ptr<UniformBuffer> light_direction_ubo;
-unique_ptr<UniformBuffer> material_ubo;
-unique_ptr<UniformBuffer> model_ubo;
+unique_ptr<CachedShaderProgram> phong_yuv_flat;
+unique_ptr<VertexArray> phong_yuv_flat_va;
+unique_ptr<CachedShaderProgram> phong_yuv_gbuffer;
+unique_ptr<VertexArray> phong_yuv_gbuffer_va;
+unique_ptr<CachedShaderProgram> deferred_phong_yuv;
+unique_ptr<VertexArray> deferred_va; // No attributes.
+unique_ptr<CachedShaderProgram> phong_yuv_planar;
+unique_ptr<VertexArray> phong_yuv_planar_va;
+unique_ptr<CachedShaderProgram> chroma_downsample;
+unique_ptr<CachedShaderProgram> raster_bin; // Null without GL 4.3.
+unique_ptr<CachedShaderProgram> raster_scan;
+unique_ptr<CachedShaderProgram> raster_tile;
+unique_ptr<CachedShaderProgram> raster_large;
+unique_ptr<UniformArena> uniforms; // Holds all uniform blocks.
+UniformArena::Block camera_block;
+UniformArena::Block light_color_block;
+UniformArena::Block light_direction_block;
+UniformArena::Block material_block;
+UniformArena::Block model_block;
+UniformArena::Block animation_block;
 unique_ptr<ArrayBuffer> obj_pos_vbo;
 unique_ptr<ArrayBuffer> yuv_vbo;
 unique_ptr<ElementArrayBuffer> tri_index_ibo;
+unique_ptr<ArrayBuffer> face_normal_buf; // Read as a texture buffer.
+GLuint face_normal_tex = 0;
+unique_ptr<ArrayBuffer> raster_tile_range_buf; // Compute rasterizer bins.
+unique_ptr<ArrayBuffer> raster_tile_triangle_buf;
+unique_ptr<ArrayBuffer> raster_large_buf;
+unique_ptr<Texture2D> raster_owner_tex; // Triangle owning each pixel.
 unique_ptr<Framebuffer> fbo;
 unique_ptr<Texture2D> rgb_tex;
+unique_ptr<Texture2D> gbuffer_normal_tex; // fbo attachment 1 if deferred.
+unique_ptr<Texture2D> gbuffer_yuv_tex; // fbo attachment 2 if deferred.
+unique_ptr<Framebuffer> planar_fbo; // Y and full resolution Cb Cr.
+unique_ptr<Texture2D> y_tex;
+unique_ptr<Texture2D> cbcr_full_tex;
+unique_ptr<Framebuffer> chroma_fbo; // Half resolution Cb Cr.
+unique_ptr<Texture2D> cbcr_tex;
 //unique_ptr<Renderbuffer> rbo;
-unique_ptr<ShaderProgram> screen_tex;
-unique_ptr<UniformBuffer> screen_tex_camera_ubo;
-unique_ptr<UniformBuffer> screen_tex_model_ubo;
+unique_ptr<PixelReadbackRing> readback;
+unique_ptr<PassProfiler> profiler; // Null unless --profile.
+GlStateCache gl_state; // Bindings of the render passes.
+unique_ptr<CachedShaderProgram> screen_tex;
+UniformArena::Block screen_tex_camera_block;
+UniformArena::Block screen_tex_model_block;
 unique_ptr<VertexArray> screen_tex_va;
 unique_ptr<ArrayBuffer> screen_tex_obj_pos_vbo;
 unique_ptr<ArrayBuffer> screen_tex_uv_vbo;
@@ -50,7 +132,6 @@ unique_ptr<ElementArrayBuffer> screen_tex_tri_ibo;
 
 typedef vec<2, GLfloat> Vec2f;
 typedef vec<3, GLfloat> Vec3f;
-typedef vec<3, GLushort> Vec3us;
 
 GLfloat triangleArea(const Vec3f& v0, const Vec3f& v1, const Vec3f& v2) {
   return 0.5f * mag(cross(v2 - v0, v2 - v1));
@@ -63,11 +144,11 @@ Vec3f triangleCenter(const Vec3f& v0, const Vec3f& v1, const Vec3f& v2) {
 struct Triangle
 {
   Triangle() : i(0), j(0), k(0) {}
-  Triangle(const GLushort i, const GLushort j, const GLushort k)
+  Triangle(const GLuint i, const GLuint j, const GLuint k)
     : i(i), j(j), k(k) {}
-  GLushort i;
-  GLushort j;
-  GLushort k;
+  GLuint i;
+  GLuint j;
+  GLuint k;
 };
 
 template <typename T>
@@ -83,6 +164,291 @@ struct Pixel
 typedef Pixel<float> Pixelf;
 typedef Pixel<uint8_t> Pixel8ui;
 
+//! How makeMesh() places vertices.
+enum MeshMode
+{
+  kPoissonMesh,    // Poisson disk sampling, Delaunay triangulation.
+  kPointTileMesh,  // Precomputed point tiles, Delaunay triangulation.
+  kImportanceMesh, // Radius from an importance image, Delaunay triangulation.
+  kLatticeMesh     // Jittered lattice with closed-form connectivity.
+};
+
+//! Format of the written image.
+enum OutputFormat
+{
+  kRgbOutput,  // PPM.
+  kNv12Output, // Y plane, then interleaved half resolution Cb Cr.
+  kI420Output  // Y, Cb and Cr planes, chroma at half resolution.
+};
+
+//! How renderTexture() rasterizes the mesh.
+enum RasterMode
+{
+  kAutoRaster,     // Compute below kComputeRasterMaxArea, else hardware.
+  kHardwareRaster, // Graphics pipeline.
+  kComputeRaster   // Binned compute shaders, see renderTextureCompute().
+};
+
+//! Command line options, given as --name=value.
+struct Options
+{
+  Options()
+    : mesh_mode(kPoissonMesh), radius(1.5f), radius_min(0.375f),
+      jitter(0.2f), seed(1954), levels(1), headless(false),
+      continuous(false), capture_frames(0), output_width(0),
+      output_height(0), batch_size(0), flat_pipeline(false),
+      bench_pipelines(0), deferred(false), light_sweep(0),
+      output_format(kRgbOutput), quad_present(false), bench_present(0),
+      bench_frames(0), bench_seconds(0.), bench_warmup(10), fps_limit(0.),
+      animate_z(0.f), animate_u(0.f), animate_v(0.f),
+      raster_mode(kAutoRaster), bench_raster(0) {}
+  MeshMode mesh_mode;
+  GLfloat radius; // Largest sample spacing for kImportanceMesh, lattice
+                  // spacing for kLatticeMesh.
+  GLfloat radius_min; // Sample spacing where importance is 1.
+  GLfloat jitter; // Fraction of the lattice spacing, below 0.25.
+  uint32_t seed;
+  uint32_t levels; // Mesh pyramid levels, spacing doubles per level.
+  bool headless; // Render once without a window, write and exit.
+  bool continuous; // Redraw every frame even if nothing changed.
+  uint32_t capture_frames; // FBO renders written as frame-NNNN.ppm.
+  GLsizei output_width; // Tiled output size, 0 to write the FBO.
+  GLsizei output_height;
+  uint32_t batch_size; // Seed variants rendered in one pass, 0 for none.
+  bool flat_pipeline; // Draw without the geometry shader.
+  uint32_t bench_pipelines; // Frames per pipeline to time, 0 for none.
+  bool deferred; // Rasterize into a G-buffer once, light per pixel.
+  uint32_t light_sweep; // Light directions written as light-NNNN.ppm.
+  OutputFormat output_format;
+  bool quad_present; // Present through screen_tex instead of a blit.
+  uint32_t bench_present; // Frames per present path to time, 0 for none.
+  uint32_t bench_frames; // Timed frames without vsync, 0 for none.
+  double bench_seconds; // Timed duration, overrides bench_frames if set.
+  uint32_t bench_warmup; // Untimed frames before a benchmark.
+  double fps_limit; // Frame rate cap of the window loop, 0 for none.
+  GLfloat animate_z; // Vertex animation amplitudes, 0 for none.
+  GLfloat animate_u;
+  GLfloat animate_v;
+  RasterMode raster_mode;
+  uint32_t bench_raster; // Frames per rasterizer and level, 0 for none.
+  string importance_filename; // 8-bit PGM.
+  string profile_filename; // Pass timings as JSON, empty for none.
+};
+
+Options options;
+
+//! True if the mesh moves over time. parseOptions() rejects the flat
+//! pipeline and the compute rasterizer with animation, neither animates.
+bool animating()
+{
+  return options.animate_z != 0.f || options.animate_u != 0.f ||
+         options.animate_v != 0.f;
+}
+
+//! Everything makeMesh() output depends on. Used as the mesh cache key.
+struct MeshParams
+{
+  MeshMode mode;
+  GLfloat x_min;
+  GLfloat y_min;
+  GLfloat z_min;
+  GLfloat x_max;
+  GLfloat y_max;
+  GLfloat z_max;
+  GLfloat u_min;
+  GLfloat u_max;
+  GLfloat v_min;
+  GLfloat v_max;
+  GLfloat radius;
+  uint32_t seed;
+  GLfloat radius_min;
+  string importance_filename;
+  GLfloat jitter;
+  uint32_t levels;
+};
+
+MeshParams scene_mesh_params; // Set by initScene().
+
+//! Hash fields one by one so that struct padding never enters the key.
+uint64_t meshParamsKey(const MeshParams& p)
+{
+  uint64_t key = hashValue(p.x_min);
+  key = hashValue(p.y_min, key);
+  key = hashValue(p.z_min, key);
+  key = hashValue(p.x_max, key);
+  key = hashValue(p.y_max, key);
+  key = hashValue(p.z_max, key);
+  key = hashValue(p.u_min, key);
+  key = hashValue(p.u_max, key);
+  key = hashValue(p.v_min, key);
+  key = hashValue(p.v_max, key);
+  key = hashValue(p.radius, key);
+  key = hashValue(p.seed, key);
+  key = hashValue(p.mode, key);
+  key = hashValue(p.levels, key);
+  if (p.mode == kPointTileMesh) {
+    // The samples depend on the tile set contents.
+    const MappedFile tiles(kPointTilesFilename);
+    key = hashBytes(tiles.data(), tiles.size(), key);
+  }
+  if (p.mode == kImportanceMesh) {
+    const MappedFile importance(p.importance_filename);
+    key = hashValue(p.radius_min, key);
+    key = hashBytes(importance.data(), importance.size(), key);
+  }
+  if (p.mode == kLatticeMesh) {
+    key = hashValue(p.jitter, key);
+  }
+  return key;
+}
+
+//! DOCS
+void parseOptions(int argc, char* argv[])
+{
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    const size_t eq = arg.find('=');
+    const string name = arg.substr(0, eq);
+    const string value = eq == string::npos ? string() : arg.substr(eq + 1);
+    if (name == "--mesh" && value == "poisson") {
+      options.mesh_mode = kPoissonMesh;
+    }
+    else if (name == "--mesh" && value == "tiles") {
+      options.mesh_mode = kPointTileMesh;
+    }
+    else if (name == "--mesh" && value == "lattice") {
+      options.mesh_mode = kLatticeMesh;
+    }
+    else if (name == "--jitter" && !value.empty()) {
+      options.jitter = stof(value);
+      if (!(0.f <= options.jitter && options.jitter < 0.25f)) {
+        throw runtime_error("jitter must be in [0, 0.25)");
+      }
+    }
+    else if (name == "--importance" && !value.empty()) {
+      options.mesh_mode = kImportanceMesh;
+      options.importance_filename = value;
+    }
+    else if (name == "--radius-min" && !value.empty()) {
+      options.radius_min = stof(value);
+    }
+    else if (name == "--radius" && !value.empty()) {
+      options.radius = stof(value);
+    }
+    else if (name == "--levels" && !value.empty()) {
+      options.levels = static_cast<uint32_t>(stoul(value));
+      if (options.levels < 1 || options.levels > MeshCacheFile::kMaxLevels) {
+        throw runtime_error("levels must be in [1, " +
+                            to_string(MeshCacheFile::kMaxLevels) + "]");
+      }
+    }
+    else if (name == "--headless" && value.empty()) {
+      options.headless = true;
+    }
+    else if (name == "--continuous" && value.empty()) {
+      options.continuous = true;
+    }
+    else if (name == "--capture" && !value.empty()) {
+      options.capture_frames = static_cast<uint32_t>(stoul(value));
+    }
+    else if (name == "--output-size" && !value.empty()) {
+      const size_t x = value.find('x');
+      options.output_width = stoi(value.substr(0, x));
+      options.output_height =
+        x == string::npos ? 0 : stoi(value.substr(x + 1));
+      if (options.output_width <= 0 || options.output_height <= 0) {
+        throw runtime_error("output size must be WIDTHxHEIGHT");
+      }
+    }
+    else if (name == "--batch" && !value.empty()) {
+      options.batch_size = static_cast<uint32_t>(stoul(value));
+    }
+    else if (name == "--pipeline" && value == "gs") {
+      options.flat_pipeline = false;
+    }
+    else if (name == "--pipeline" && value == "flat") {
+      options.flat_pipeline = true;
+    }
+    else if (name == "--raster" && value == "auto") {
+      options.raster_mode = kAutoRaster;
+    }
+    else if (name == "--raster" && value == "hw") {
+      options.raster_mode = kHardwareRaster;
+    }
+    else if (name == "--raster" && value == "compute") {
+      options.raster_mode = kComputeRaster;
+    }
+    else if (name == "--bench-raster" && !value.empty()) {
+      options.bench_raster = static_cast<uint32_t>(stoul(value));
+    }
+    else if (name == "--bench-pipelines" && !value.empty()) {
+      options.bench_pipelines = static_cast<uint32_t>(stoul(value));
+    }
+    else if (name == "--deferred" && value.empty()) {
+      options.deferred = true;
+    }
+    else if (name == "--light-sweep" && !value.empty()) {
+      options.light_sweep = static_cast<uint32_t>(stoul(value));
+    }
+    else if (name == "--yuv" && value == "nv12") {
+      options.output_format = kNv12Output;
+    }
+    else if (name == "--yuv" && value == "i420") {
+      options.output_format = kI420Output;
+    }
+    else if (name == "--present" && value == "blit") {
+      options.quad_present = false;
+    }
+    else if (name == "--present" && value == "quad") {
+      options.quad_present = true;
+    }
+    else if (name == "--bench-present" && !value.empty()) {
+      options.bench_present = static_cast<uint32_t>(stoul(value));
+    }
+    else if (name == "--bench-frames" && !value.empty()) {
+      options.bench_frames = static_cast<uint32_t>(stoul(value));
+    }
+    else if (name == "--bench-seconds" && !value.empty()) {
+      options.bench_seconds = stod(value);
+    }
+    else if (name == "--bench-warmup" && !value.empty()) {
+      options.bench_warmup = static_cast<uint32_t>(stoul(value));
+    }
+    else if (name == "--fps-limit" && !value.empty()) {
+      options.fps_limit = stod(value);
+      if (!(options.fps_limit >= 0.)) {
+        throw runtime_error("fps limit must not be negative");
+      }
+    }
+    else if (name == "--animate" && !value.empty()) {
+      options.animate_z = stof(value);
+    }
+    else if (name == "--animate-uv" && !value.empty()) {
+      const size_t comma = value.find(',');
+      options.animate_u = stof(value.substr(0, comma));
+      options.animate_v = comma == string::npos
+        ? options.animate_u : stof(value.substr(comma + 1));
+    }
+    else if (name == "--profile" && !value.empty()) {
+      options.profile_filename = value;
+    }
+    else if (name == "--seed" && !value.empty()) {
+      options.seed = static_cast<uint32_t>(stoul(value));
+    }
+    else {
+      throw runtime_error("unknown option: " + arg);
+    }
+  }
+
+  // Only the phong_yuv vertex shader animates the mesh.
+  if (animating() && options.flat_pipeline) {
+    throw runtime_error("--animate is not supported with --pipeline=flat");
+  }
+  if (animating() && options.raster_mode == kComputeRaster) {
+    throw runtime_error("--animate is not supported with --raster=compute");
+  }
+}
+
 
 void writeObj(const string& filename, const vector<Vec3f>& vtx,
               const vector<Triangle>& tris)
@@ -99,16 +465,22 @@ void writeObj(const string& filename, const vector<Vec3f>& vtx,
 }
 
 void writePpm(const string& filename, size_t width, size_t height,
-              const vector<Pixel8ui>& pixels)
+              const Pixel8ui* pixels)
 {
   ofstream ofs(filename, ios_base::out | ios_base::binary | ios_base::trunc);
   ofs << "P6" << endl;
   ofs << width << " " << height << endl;
   ofs << 255 << endl;
-  ofs.write(reinterpret_cast<const char*>(pixels.data()),
-            pixels.size() * sizeof(Pixel8ui));
+  ofs.write(reinterpret_cast<const char*>(pixels),
+            width * height * sizeof(Pixel8ui));
   ofs.close();
 }
+void writePpm(const string& filename, size_t width, size_t height,
+              const vector<Pixel8ui>& pixels)
+{
+  assert(pixels.size() == width * height);
+  writePpm(filename, width, height, pixels.data());
+}
 
 void writePpm(const string& filename, size_t width, size_t height,
               const vector<Pixelf>& pixels)
@@ -123,6 +495,79 @@ void writePpm(const string& filename, size_t width, size_t height,
   writePpm(filename, width, height, pixels8ui);
 }
 
+//! Reads an 8-bit binary PGM (P5). Rows are stored top to bottom.
+void readPgm(const string& filename, size_t* width, size_t* height,
+             vector<uint8_t>* pixels)
+{
+  ifstream ifs(filename, ios_base::in | ios_base::binary);
+  string magic;
+  size_t max_value = 0;
+  ifs >> magic;
+  // Skip comment lines between header fields.
+  const auto skipComments = [&ifs]() {
+    while ((ifs >> ws).peek() == '#') {
+      string comment;
+      getline(ifs, comment);
+    }
+  };
+  skipComments();
+  ifs >> *width;
+  skipComments();
+  ifs >> *height;
+  skipComments();
+  ifs >> max_value;
+  ifs.get(); // Single whitespace before the raster.
+  if (!ifs || magic != "P5" || max_value == 0 || max_value > 255) {
+    throw runtime_error("cannot read 8-bit PGM: " + filename);
+  }
+  pixels->resize(*width * *height);
+  ifs.read(reinterpret_cast<char*>(pixels->data()), pixels->size());
+  if (!ifs) {
+    throw runtime_error("truncated PGM: " + filename);
+  }
+}
+
+//! Importance in [0, 1] from a grayscale image stretched over a rectangle,
+//! bilinearly interpolated and clamped at the borders.
+struct ImportanceMap
+{
+  ImportanceMap(const string& filename,
+                const GLfloat x_min, const GLfloat y_min,
+                const GLfloat x_max, const GLfloat y_max)
+    : x_min(x_min), y_min(y_min), x_max(x_max), y_max(y_max)
+  {
+    readPgm(filename, &width, &height, &pixels);
+  }
+
+  GLfloat operator()(const array<GLfloat, 2>& p) const
+  {
+    // Image row 0 is the top, at y_max.
+    const GLfloat fx = (p[0] - x_min) / (x_max - x_min) * (width - 1);
+    const GLfloat fy = (y_max - p[1]) / (y_max - y_min) * (height - 1);
+    const GLfloat cx = min(max(fx, 0.f), static_cast<GLfloat>(width - 1));
+    const GLfloat cy = min(max(fy, 0.f), static_cast<GLfloat>(height - 1));
+    const size_t x0 = static_cast<size_t>(cx);
+    const size_t y0 = static_cast<size_t>(cy);
+    const size_t x1 = min(x0 + 1, width - 1);
+    const size_t y1 = min(y0 + 1, height - 1);
+    const GLfloat tx = cx - x0;
+    const GLfloat ty = cy - y0;
+    const GLfloat top = (1.f - tx) * pixels[y0 * width + x0] +
+                        tx * pixels[y0 * width + x1];
+    const GLfloat bottom = (1.f - tx) * pixels[y1 * width + x0] +
+                           tx * pixels[y1 * width + x1];
+    return ((1.f - ty) * top + ty * bottom) / 255.f;
+  }
+
+  GLfloat x_min;
+  GLfloat y_min;
+  GLfloat x_max;
+  GLfloat y_max;
+  size_t width;
+  size_t height;
+  vector<uint8_t> pixels;
+};
+
 
 //! DOCS
 void framebufferSizeCallback(GLFWwindow* win,
@@ -132,7 +577,13 @@ void framebufferSizeCallback(GLFWwindow* win,
 
   win_width = w;
   win_height = h;
-  viewport(0, 0, w, h);
+  screen_dirty = true; // renderScreen() sets the viewport.
+}
+
+//! DOCS
+void windowRefreshCallback(GLFWwindow* win)
+{
+  screen_dirty = true; // Window contents damaged, e.g. uncovered.
 }
 
 //! DOCS
@@ -162,18 +613,32 @@ void scrollCallback(GLFWwindow* win, double xoffset, double yoffset)
   //cout << "scrollCallback" << endl;
 }
 
-//! DOCS
-void bindUniformBuffer(ndj::ShaderProgram const& shaderProgram,
-                       std::string const& uniformBlockName,
-                       ndj::UniformBuffer const& ubo)
+//! Allocates an arena block for the named uniform block of shaderProgram,
+//! fills it with data and binds it to the uniform block's binding point.
+UniformArena::Block makeUniformBlock(
+  CachedShaderProgram const& shaderProgram,
+  std::string const& uniformBlockName,
+  void const* data,
+  std::size_t const size)
 {
-  UniformBlock const& uniformBlock =
+  CachedShaderProgram::UniformBlock const& uniformBlock =
     shaderProgram.activeUniformBlock(uniformBlockName);
-  if (uniformBlock.size() != ubo.sizeInBytes()) {
+  if (static_cast<std::size_t>(uniformBlock.size()) != size) {
     NDJINN_THROW("uniform block and uniform buffer size mismatch");
   }
 
-  ubo.bindBase(uniformBlock.binding());
+  UniformArena::Block const block = uniforms->allocate(size);
+  uniforms->write(block, data);
+  uniforms->bind(uniformBlock.binding(), block);
+  return block;
+}
+
+//! Rewrites a uniform block in the next arena region, so draws issued
+//! before still read the old values.
+void updateUniformBlock(UniformArena::Block const& block, void const* data)
+{
+  uniforms->nextRegion();
+  uniforms->write(block, data);
 }
 
 //! DOCS
@@ -184,7 +649,13 @@ void initGLFW(const int width, const int height)
     throw runtime_error("GLFW init error");
   }
 
-  glfwWindowHint(GLFW_SAMPLES, 4);
+  // Blits cannot write to a multisampled default framebuffer.
+  if (options.quad_present && options.bench_present == 0) {
+    glfwWindowHint(GLFW_SAMPLES, 4);
+  }
+#ifndef NDEBUG
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
 
   win = glfwCreateWindow(width, height, "yuv-valence", nullptr, nullptr);
   if (win == nullptr)
@@ -197,6 +668,20 @@ void initGLFW(const int width, const int height)
   glfwSetCursorPosCallback(win, cursorPosCallback);
   glfwSetMouseButtonCallback(win, mouseButtonCallback);
   glfwSetScrollCallback(win, scrollCallback);
+  glfwSetWindowRefreshCallback(win, windowRefreshCallback);
+}
+
+//! Creates a windowless GL context for rendering into the FBO only. No
+//! default framebuffer, so nothing is multisampled or swapped.
+void initHeadless()
+{
+#ifdef _WIN32
+  throw runtime_error("headless mode needs EGL, not available on Windows");
+#else
+  egl_context.reset(new EglContext(4, 2));
+  cout << "EGL context: "
+       << (egl_context->surfaceless() ? "surfaceless" : "pbuffer") << endl;
+#endif
 }
 
 //! DOCS
@@ -205,6 +690,14 @@ void initGLEW()
   try {
     glewExperimental = GL_TRUE;
     GLenum const glewErr = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLX builds of GLEW report this for EGL contexts, the GL entry points
+    // are loaded anyway.
+    if (GLEW_ERROR_NO_GLX_DISPLAY == glewErr && win == nullptr) {
+      checkError("glewInit");
+      return;
+    }
+#endif
     if (GLEW_OK != glewErr) {
       // glewInit failed, something is seriously wrong.
       cerr << "GLEW init error: " << glewGetErrorString(glewErr) << endl;
@@ -219,6 +712,14 @@ void initGLEW()
 
 void initGL()
 {
+#ifdef NDEBUG
+  const bool debug_synchronous = false;
+#else
+  const bool debug_synchronous = true;
+#endif
+  if (!enableDebugOutput(debug_synchronous)) {
+    cerr << "Warning: no KHR_debug, GL errors are not reported" << endl;
+  }
   clearColor(0.2f, 0.2f, 0.2f, 1.f);
   clearDepth(1.0);
   depthRange(0.0, 1.0);
@@ -227,8 +728,10 @@ void initGL()
   cullFace(GL_BACK);
   enable(GL_CULL_FACE);
 
-  glfwGetFramebufferSize(win, &win_width, &win_height);
-  viewport(0, 0, win_width, win_height);
+  if (win != nullptr) {
+    glfwGetFramebufferSize(win, &win_width, &win_height);
+    viewport(0, 0, win_width, win_height);
+  }
 
   int glfwMajor = 0;
   int glfwMinor = 0;
@@ -268,277 +771,448 @@ void initGL()
   cout << "FBO width: " << fbo_width << endl;
   cout << "FBO height: " << fbo_height << endl;
 
-  rgb_tex.reset(new Texture2D(GL_TEXTURE_2D, fbo_width, fbo_height, 0, GL_RGB,
-                              0, GL_RGB, GL_UNSIGNED_BYTE, nullptr));
+  // Sized RGBA so the compute rasterizer can bind it as an image.
+  rgb_tex.reset(new Texture2D(GL_TEXTURE_2D, fbo_width, fbo_height, 0,
+                              GL_RGBA8, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
   setTextureParameter(*rgb_tex, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   setTextureParameter(*rgb_tex, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   cout << endl << *rgb_tex << endl;
 
   fbo.reset(new Framebuffer);
   fbo->attachTexture2D(GL_COLOR_ATTACHMENT0, rgb_tex->handle());
+  if (options.deferred) {
+    // Float targets, u and v are signed.
+    gbuffer_normal_tex.reset(new Texture2D(
+      GL_TEXTURE_2D, fbo_width, fbo_height, 0, GL_RGBA16F,
+      0, GL_RGBA, GL_FLOAT, nullptr));
+    gbuffer_yuv_tex.reset(new Texture2D(
+      GL_TEXTURE_2D, fbo_width, fbo_height, 0, GL_RGBA16F,
+      0, GL_RGBA, GL_FLOAT, nullptr));
+    fbo->attachTexture2D(GL_COLOR_ATTACHMENT1, gbuffer_normal_tex->handle());
+    fbo->attachTexture2D(GL_COLOR_ATTACHMENT2, gbuffer_yuv_tex->handle());
+  }
   cout << endl << *fbo << endl;
+
+  if (options.output_format != kRgbOutput) {
+    y_tex.reset(new Texture2D(GL_TEXTURE_2D, fbo_width, fbo_height, 0, GL_R8,
+                              0, GL_RED, GL_UNSIGNED_BYTE, nullptr));
+    cbcr_full_tex.reset(new Texture2D(
+      GL_TEXTURE_2D, fbo_width, fbo_height, 0, GL_RG8,
+      0, GL_RG, GL_UNSIGNED_BYTE, nullptr));
+    planar_fbo.reset(new Framebuffer);
+    planar_fbo->attachTexture2D(GL_COLOR_ATTACHMENT0, y_tex->handle());
+    planar_fbo->attachTexture2D(GL_COLOR_ATTACHMENT1, cbcr_full_tex->handle());
+    cbcr_tex.reset(new Texture2D(
+      GL_TEXTURE_2D, (fbo_width + 1) / 2, (fbo_height + 1) / 2, 0, GL_RG8,
+      0, GL_RG, GL_UNSIGNED_BYTE, nullptr));
+    chroma_fbo.reset(new Framebuffer);
+    chroma_fbo->attachTexture2D(GL_COLOR_ATTACHMENT0, cbcr_tex->handle());
+  }
+
+  readback.reset(new PixelReadbackRing(kReadbackRingDepth));
+  if (!options.profile_filename.empty()) {
+    profiler.reset(new PassProfiler);
+  }
 }
 
-void triangulate(const vector<Vec2f>& pos, vector<Triangle>* tri_index)
-{
-  using namespace std;
-  triangulateio triangulate_in;
-  triangulate_in.pointlist = reinterpret_cast<REAL*>(
-    malloc(pos.size() * 2 * sizeof(REAL)));
-  triangulate_in.pointattributelist = nullptr;
-  triangulate_in.pointmarkerlist = nullptr;
-  triangulate_in.numberofpoints = static_cast<int>(pos.size());
-  triangulate_in.numberofpointattributes = 0;
-  triangulate_in.trianglelist = nullptr;
-  triangulate_in.triangleattributelist = nullptr;
-  triangulate_in.trianglearealist = nullptr;
-  triangulate_in.numberoftriangles = 0;
-  triangulate_in.numberofcorners = 0;
-  triangulate_in.numberoftriangleattributes = 0;
-  triangulate_in.segmentlist = nullptr;
-  triangulate_in.segmentmarkerlist = nullptr;
-  triangulate_in.numberofsegments = 0;
-  triangulate_in.holelist = nullptr;
-  triangulate_in.numberofholes = 0;
-  triangulate_in.regionlist = nullptr;
-  triangulate_in.numberofregions = 0;
-
-  for (size_t i = 0; i < pos.size(); ++i) {
-    triangulate_in.pointlist[i * 2 + 0] = pos[i][0];
-    triangulate_in.pointlist[i * 2 + 1] = pos[i][1];
-  }
-
-  triangulateio triangulate_out;
-  triangulate_out.pointlist = nullptr; // Not needed if -N switch used.
-  triangulate_out.pointattributelist = nullptr; // Not needed if -N switch used or number of point attributes is zero.
-  triangulate_out.pointmarkerlist = nullptr; // Not needed if -N or -B switch used.
-  triangulate_out.trianglelist = nullptr; // Not needed if -E switch used.
-  triangulate_out.triangleattributelist = nullptr; // Not needed if -E switch used or number of triangle attributes is zero.
-  triangulate_out.neighborlist = nullptr; // Needed only if -n switch used.
-  triangulate_out.segmentlist = nullptr; // Needed only if segments are output (-p or -c) and -P not used:
-  triangulate_out.segmentmarkerlist = nullptr;   // Needed only if segments are output (-p or -c) and -P and -B not used:
-  triangulate_out.edgelist = nullptr; // Needed only if -e switch used.
-  triangulate_out.edgemarkerlist = nullptr; // Needed if -e used and -B not used.
-  triangulate_out.normlist = nullptr;
-
-  vector<char> triangulate_flags;
-  triangulate_flags.push_back('P'); // Suppresses the output .poly file.
-  triangulate_flags.push_back('N'); // Suppresses the output .node file.
-  //triangulate_flags.push_back('E'); // Suppresses the output .ele file.
-  triangulate_flags.push_back('c');
-  triangulate_flags.push_back('Q'); // Quiet.
-  triangulate_flags.push_back('z'); // Zero-based indexing.
-  triangulate_flags.push_back('\0'); // Null-termination.
-
-  triangulate(
-    triangulate_flags.data(),
-    &triangulate_in,
-    &triangulate_out,
-    nullptr);
-
-  assert(tri_index != nullptr);
-  tri_index->clear();
-  tri_index->resize(triangulate_out.numberoftriangles);
-  assert(triangulate_out.numberofcorners == 3);
-  for (int t = 0; t < triangulate_out.numberoftriangles; ++t) {
-    (*tri_index)[t].i = triangulate_out.trianglelist[3 * t + 0];
-    (*tri_index)[t].j = triangulate_out.trianglelist[3 * t + 1];
-    (*tri_index)[t].k = triangulate_out.trianglelist[3 * t + 2];
-  }
-
-  // Free all allocated arrays, including those allocated by Triangle.
-  free(triangulate_in.pointlist);
-  free(triangulate_out.pointlist);
-  free(triangulate_in.pointattributelist);
-  free(triangulate_out.pointattributelist);
-  free(triangulate_in.pointmarkerlist);
-  free(triangulate_out.pointmarkerlist);
-  free(triangulate_in.trianglelist);
-  free(triangulate_out.trianglelist);
-  free(triangulate_in.triangleattributelist);
-  free(triangulate_out.triangleattributelist);
-  free(triangulate_in.trianglearealist); // In only.
-  free(triangulate_out.neighborlist); // Out only.
-  free(triangulate_in.segmentlist);
-  free(triangulate_out.segmentlist);
-  free(triangulate_in.segmentmarkerlist);
-  free(triangulate_out.segmentmarkerlist);
-  free(triangulate_in.holelist); // In only.
-  free(triangulate_in.regionlist); // In only.
-  free(triangulate_out.edgelist); // Out only.
-  free(triangulate_out.edgemarkerlist); // Out only.
-  free(triangulate_out.normlist); // Out only.
-}
-
-void makeMesh(const GLfloat x_min, const GLfloat y_min, const GLfloat z_min,
-              const GLfloat x_max, const GLfloat y_max, const GLfloat z_max,
-              const GLfloat u_min, const GLfloat u_max,
-              const GLfloat v_min, const GLfloat v_max,
-              const GLfloat radius,
-              const uint32_t seed,
+void makeMesh(const MeshParams& params,
               vector<Vec3f>* obj_pos,
               vector<Vec3f>* yuv,
-              vector<Triangle>* tri_index)
+              vector<Triangle>* tri_index,
+              vector<Vec3f>* face_normal,
+              vector<MeshLevel>* levels)
 {
   assert(obj_pos != nullptr);
   assert(yuv != nullptr);
+  assert(face_normal != nullptr);
+  assert(levels != nullptr);
+  const GLfloat x_min = params.x_min;
+  const GLfloat y_min = params.y_min;
+  const GLfloat z_min = params.z_min;
+  const GLfloat x_max = params.x_max;
+  const GLfloat y_max = params.y_max;
+  const GLfloat z_max = params.z_max;
+  const GLfloat u_min = params.u_min;
+  const GLfloat u_max = params.u_max;
+  const GLfloat v_min = params.v_min;
+  const GLfloat v_max = params.v_max;
+  const GLfloat radius = params.radius;
+  const uint32_t seed = params.seed;
   const array<GLfloat, 2> sampling_min = { x_min - 2.f * radius,
                                            y_min - 2.f * radius };
   const array<GLfloat, 2> sampling_max = { x_max + 2.f * radius,
                                            y_max + 2.f * radius};
-  const vector<array<GLfloat, 2>> samples =
-    thinks::poissonDiskSampling(radius, sampling_min, sampling_max, 30, seed);
+  vector<array<GLfloat, 2>> samples;
+  vector<GLfloat> z_scale; // Per vertex, empty for uniform spacing.
+  if (params.mode == kImportanceMesh) {
+    // Spacing goes from radius where importance is 0 down to radius_min
+    // where it is 1.
+    const ImportanceMap importance(params.importance_filename,
+                                   x_min, y_min, x_max, y_max);
+    const GLfloat radius_min = params.radius_min;
+    const auto radius_fn = [&](const array<GLfloat, 2>& p) {
+      return radius + (radius_min - radius) * importance(p);
+    };
+    samples = variablePoissonDiskSampling(
+      radius_fn, radius_min, radius, sampling_min, sampling_max, 30, seed);
+
+    // Scale z offsets with the local spacing, so that face slopes, and
+    // thereby shading, have the same distribution in dense and sparse
+    // regions.
+    z_scale.resize(samples.size());
+    for (size_t i = 0; i < samples.size(); ++i) {
+      z_scale[i] = radius_fn(samples[i]) / radius;
+    }
+  }
+  else if (params.mode == kLatticeMesh) {
+    makeJitteredLattice(radius, params.jitter, sampling_min, sampling_max,
+                        seed, &samples, tri_index);
+  }
+  else if (params.mode == kPointTileMesh) {
+    const PointTileSet tile_set(kPointTilesFilename);
+    if (!tile_set.valid()) {
+      throw runtime_error(string("invalid point tile set ") +
+                          kPointTilesFilename + ", run make-point-tiles");
+    }
+    samples = tiledPointSamples(tile_set, radius, sampling_min, sampling_max, seed);
+  }
+  else {
+    samples =
+      tiledPoissonDiskSampling(radius, sampling_min, sampling_max, 30, seed);
+  }
+
+  // Split the samples into nested levels and sort them coarsest level
+  // first, so that every level uses a prefix of the vertex arrays.
+  const uint32_t level_count = params.levels;
+  vector<size_t> level_vertex_count(level_count, samples.size());
+  if (level_count > 1) {
+    vector<GLfloat> sample_radius(samples.size(), radius);
+    for (size_t i = 0; i < z_scale.size(); ++i) {
+      sample_radius[i] = radius * z_scale[i];
+    }
+    const vector<uint32_t> level_of =
+      nestedSampleLevels(samples, sample_radius, level_count, seed);
+    vector<size_t> order(samples.size());
+    iota(order.begin(), order.end(), size_t(0));
+    stable_sort(order.begin(), order.end(),
+                [&](const size_t a, const size_t b) {
+                  return level_of[a] > level_of[b];
+                });
+    vector<GLuint> new_index(samples.size());
+    vector<array<GLfloat, 2>> sorted_samples(samples.size());
+    vector<GLfloat> sorted_z_scale(z_scale.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      new_index[order[i]] = static_cast<GLuint>(i);
+      sorted_samples[i] = samples[order[i]];
+      if (!z_scale.empty()) {
+        sorted_z_scale[i] = z_scale[order[i]];
+      }
+    }
+    samples.swap(sorted_samples);
+    z_scale.swap(sorted_z_scale);
+    for (Triangle& t : *tri_index) {
+      t = Triangle(new_index[t.i], new_index[t.j], new_index[t.k]);
+    }
+    for (uint32_t l = 1; l < level_count; ++l) {
+      level_vertex_count[l] = static_cast<size_t>(
+        count_if(level_of.begin(), level_of.end(),
+                 [l](const uint32_t v) { return v >= l; }));
+    }
+  }
+
   vector<Vec2f> obj_pos_xy(samples.size());
   for (size_t i = 0; i < samples.size(); ++i) {
     obj_pos_xy[i][0] = samples[i][0];
     obj_pos_xy[i][1] = samples[i][1];
   }
 
-  triangulate(obj_pos_xy, tri_index);
+  // Level 0 uses all vertices, the lattice keeps its own connectivity. The
+  // coarser levels are always Delaunay triangulations of their prefix.
+  if (params.mode != kLatticeMesh) {
+    triangulate(obj_pos_xy, tri_index);
+  }
+  levels->clear();
+  const MeshLevel finest = { obj_pos_xy.size(), 0, tri_index->size() };
+  levels->push_back(finest);
+  for (uint32_t l = 1; l < level_count; ++l) {
+    const vector<Vec2f> prefix(obj_pos_xy.begin(),
+                               obj_pos_xy.begin() + level_vertex_count[l]);
+    vector<Triangle> level_tri_index;
+    triangulate(prefix, &level_tri_index);
+    const MeshLevel level = {
+      prefix.size(), tri_index->size(), level_tri_index.size() };
+    levels->push_back(level);
+    tri_index->insert(tri_index->end(),
+                      level_tri_index.begin(), level_tri_index.end());
+  }
 
-  // Compute triangle vertices in 3D, adding a random offset in Z.
-  random_device rd;
-  mt19937 gen(rd());
-  uniform_real_distribution<GLfloat> dis(z_min, z_max);
+  // Compute triangle vertices in 3D, adding a random offset in Z. Offsets
+  // are keyed by seed and vertex index, so the result does not depend on
+  // how the vertices are split across threads.
+  const uint64_t z_key = streamKey(seed, kZOffsetStream);
+  const size_t vertex_count = obj_pos_xy.size();
   obj_pos->clear();
-  obj_pos->resize(obj_pos_xy.size());
+  obj_pos->resize(vertex_count);
   yuv->clear();
-  yuv->resize(samples.size());
-  for (size_t i = 0; i < obj_pos_xy.size(); ++i) {
-    (*obj_pos)[i][0] = obj_pos_xy[i][0];
-    (*obj_pos)[i][1] = obj_pos_xy[i][1];
-    (*obj_pos)[i][2] = dis(gen);
-    const GLfloat tu = ((*obj_pos)[i][0] - x_min) / (x_max - x_min);
-    const GLfloat tv = ((*obj_pos)[i][1] - y_min) / (y_max - y_min);
-    (*yuv)[i][0] = 0.5f;
-    (*yuv)[i][1] = u_min + (u_max - u_min) * tu;
-    (*yuv)[i][2] = v_min + (v_max - v_min) * tv;
+  yuv->resize(vertex_count);
+  const Vec2f* xy = obj_pos_xy.data();
+  Vec3f* pos = obj_pos->data();
+  Vec3f* col = yuv->data();
+  const GLfloat* zs = z_scale.empty() ? nullptr : z_scale.data();
+  const GLfloat z_mid = 0.5f * (z_min + z_max);
+  const GLfloat tu_scale = 1.f / (x_max - x_min);
+  const GLfloat tv_scale = 1.f / (y_max - y_min);
+  parallelFor(vertex_count, kMeshChunkSize,
+    [=](const size_t begin, const size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        pos[i][0] = xy[i][0];
+        pos[i][1] = xy[i][1];
+        pos[i][2] = uniformFloat(z_key, i, z_min, z_max);
+      }
+      if (zs != nullptr) {
+        for (size_t i = begin; i < end; ++i) {
+          pos[i][2] = z_mid + (pos[i][2] - z_mid) * zs[i];
+        }
+      }
+      for (size_t i = begin; i < end; ++i) {
+        const GLfloat tu = (xy[i][0] - x_min) * tu_scale;
+        const GLfloat tv = (xy[i][1] - y_min) * tv_scale;
+        col[i][0] = 0.5f;
+        col[i][1] = u_min + (u_max - u_min) * tu;
+        col[i][2] = v_min + (v_max - v_min) * tv;
+      }
+    });
+
+  // Object space face normals for the flat pipeline, same winding as
+  // phong_yuv.gs.
+  const size_t triangle_count = tri_index->size();
+  face_normal->clear();
+  face_normal->resize(triangle_count);
+  const Triangle* tri = tri_index->data();
+  Vec3f* normal = face_normal->data();
+  parallelFor(triangle_count, kMeshChunkSize,
+    [=](const size_t begin, const size_t end) {
+      for (size_t t = begin; t < end; ++t) {
+        const Vec3f& p0 = pos[tri[t].i];
+        const Vec3f& p1 = pos[tri[t].j];
+        const Vec3f& p2 = pos[tri[t].k];
+        const Vec3f n = cross(p2 - p1, p0 - p1);
+        const GLfloat length = mag(n);
+        normal[t] = length > 0.f ? (1.f / length) * n : Vec3f(0.f, 0.f, 1.f);
+      }
+    });
+}
+
+//! Builds a program from shader files, gs_filename may be null. Loads
+//! the program binary from the shader cache if the sources are unchanged.
+unique_ptr<CachedShaderProgram> makeShaderProgram(const char* vs_filename,
+                                                  const char* gs_filename,
+                                                  const char* fs_filename)
+{
+  vector<ShaderSource> sources;
+  sources.push_back({ GL_VERTEX_SHADER, readShaderFile(vs_filename) });
+  if (gs_filename != nullptr) {
+    sources.push_back({ GL_GEOMETRY_SHADER, readShaderFile(gs_filename) });
   }
+  sources.push_back({ GL_FRAGMENT_SHADER, readShaderFile(fs_filename) });
+  return unique_ptr<CachedShaderProgram>(
+    new CachedShaderProgram(sources, kShaderCacheDirectory));
+}
+
+//! Builds a compute program from common_filename followed by
+//! cs_filename, so passes can share declarations. Cached like
+//! makeShaderProgram().
+unique_ptr<CachedShaderProgram> makeComputeProgram(
+  const char* common_filename, const char* cs_filename)
+{
+  vector<ShaderSource> sources;
+  sources.push_back({ GL_COMPUTE_SHADER, readShaderFile(common_filename) +
+                                         readShaderFile(cs_filename) });
+  return unique_ptr<CachedShaderProgram>(
+    new CachedShaderProgram(sources, kShaderCacheDirectory));
 }
 
 void buildShaderPrograms()
 {
-  phong_yuv.reset(new ShaderProgram(
-    VertexShader(readShaderFile("shaders/phong_yuv.vs")),
-    GeometryShader(readShaderFile("shaders/phong_yuv.gs")),
-    FragmentShader(readShaderFile("shaders/phong_yuv.fs"))));
+  phong_yuv = makeShaderProgram(
+    "shaders/phong_yuv.vs", "shaders/phong_yuv.gs", "shaders/phong_yuv.fs");
   phong_yuv->activeUniformBlock("Camera").bind(1);
   phong_yuv->activeUniformBlock("LightColor").bind(2);
   phong_yuv->activeUniformBlock("LightDirection").bind(3);
   phong_yuv->activeUniformBlock("Material").bind(4);
   phong_yuv->activeUniformBlock("Model").bind(5);
+  phong_yuv->activeUniformBlock("Animation").bind(8);
   cout << "phong_yuv:" << endl << *phong_yuv << endl;
 
-  screen_tex.reset(new ShaderProgram(
-    VertexShader(readShaderFile("shaders/screen_tex.vs")),
-    FragmentShader(readShaderFile("shaders/screen_tex.fs"))));
+  // Same uniform block bindings, so both programs share the buffers.
+  phong_yuv_flat = makeShaderProgram(
+    "shaders/phong_yuv_flat.vs", nullptr, "shaders/phong_yuv_flat.fs");
+  phong_yuv_flat->activeUniformBlock("Camera").bind(1);
+  phong_yuv_flat->activeUniformBlock("LightColor").bind(2);
+  phong_yuv_flat->activeUniformBlock("LightDirection").bind(3);
+  phong_yuv_flat->activeUniformBlock("Material").bind(4);
+  phong_yuv_flat->activeUniformBlock("Model").bind(5);
+  cout << "phong_yuv_flat:" << endl << *phong_yuv_flat << endl;
+
+  phong_yuv_gbuffer = makeShaderProgram(
+    "shaders/phong_yuv.vs",
+    "shaders/phong_yuv.gs",
+    "shaders/phong_yuv_gbuffer.fs");
+  phong_yuv_gbuffer->activeUniformBlock("Camera").bind(1);
+  phong_yuv_gbuffer->activeUniformBlock("Model").bind(5);
+  phong_yuv_gbuffer->activeUniformBlock("Animation").bind(8);
+  cout << "phong_yuv_gbuffer:" << endl << *phong_yuv_gbuffer << endl;
+
+  deferred_phong_yuv = makeShaderProgram(
+    "shaders/deferred_phong_yuv.vs", nullptr, "shaders/deferred_phong_yuv.fs");
+  deferred_phong_yuv->activeUniformBlock("LightColor").bind(2);
+  deferred_phong_yuv->activeUniformBlock("LightDirection").bind(3);
+  deferred_phong_yuv->activeUniformBlock("Material").bind(4);
+  cout << "deferred_phong_yuv:" << endl << *deferred_phong_yuv << endl;
+  deferred_va.reset(new VertexArray);
+
+  phong_yuv_planar = makeShaderProgram(
+    "shaders/phong_yuv.vs",
+    "shaders/phong_yuv.gs",
+    "shaders/phong_yuv_planar.fs");
+  phong_yuv_planar->activeUniformBlock("Camera").bind(1);
+  phong_yuv_planar->activeUniformBlock("LightColor").bind(2);
+  phong_yuv_planar->activeUniformBlock("LightDirection").bind(3);
+  phong_yuv_planar->activeUniformBlock("Material").bind(4);
+  phong_yuv_planar->activeUniformBlock("Model").bind(5);
+  phong_yuv_planar->activeUniformBlock("Animation").bind(8);
+  cout << "phong_yuv_planar:" << endl << *phong_yuv_planar << endl;
+
+  chroma_downsample = makeShaderProgram(
+    "shaders/deferred_phong_yuv.vs", nullptr, "shaders/chroma_downsample.fs");
+
+  screen_tex = makeShaderProgram(
+    "shaders/screen_tex.vs", nullptr, "shaders/screen_tex.fs");
   screen_tex->activeUniformBlock("Camera").bind(6);
   screen_tex->activeUniformBlock("Model").bind(7);
   cout << "screen_tex:" << endl << *screen_tex << endl;
+
+  // Compute rasterizer, uniform block bindings are set in the shaders.
+  if (GLEW_VERSION_4_3) {
+    const char* const common = "shaders/raster_common.glsl";
+    raster_bin = makeComputeProgram(common, "shaders/raster_bin.cs");
+    raster_scan = makeComputeProgram(common, "shaders/raster_scan.cs");
+    raster_tile = makeComputeProgram(common, "shaders/raster_tile.cs");
+    raster_large = makeComputeProgram(common, "shaders/raster_large.cs");
+  }
+  else if (options.raster_mode == kComputeRaster) {
+    throw runtime_error("--raster=compute needs OpenGL 4.3 compute shaders");
+  }
 }
 
-void initScene()
+//! Mesh arrays ready for upload, either generated or mapped from the cache.
+struct MeshData
 {
-  const GLfloat x_min = -10.f;
-  const GLfloat y_min = -10.f;
-  const GLfloat z_min = -1.f;
-  const GLfloat x_max = 10.f;
-  const GLfloat y_max = 10.f;
-  const GLfloat z_max = 1.f;
-  const GLfloat u_min = -0.436f;
-  const GLfloat u_max =  0.436f;
-  const GLfloat v_min = -0.615f;
-  const GLfloat v_max =  0.615f;
-  const GLfloat radius = 1.5f;
-  const uint32_t seed = 1954;
-
-  // --------------------------
-  // Initialize uniform blocks.
-  // --------------------------
-
-  // Camera.
-  array<GLfloat, 2 * 16> camera = {
-    1.f, 0.f, 0.f, 0.f, // view_from_world matrix, column 0.
-    0.f, 1.f, 0.f, 0.f,
-    0.f, 0.f, 1.f, 0.f,
-    0.f, 0.f, 0.f, 1.f,
-    1.f, 0.f, 0.f, 0.f, // clip_from_view, column 0.
-    0.f, 1.f, 0.f, 0.f,
-    0.f, 0.f, 1.f, 0.f,
-    0.f, 0.f, 0.f, 1.f };
-  makeOrthographicProjectionMatrix(
-    x_min, x_max,
-    y_min, y_max,
-    z_min, z_max,
-    &camera[16]);
-  camera_ubo.reset(new UniformBuffer(
-    camera.size() * sizeof(GLfloat), camera.data()));
-  bindUniformBuffer(*phong_yuv, "Camera", *camera_ubo);
-
-  // Light color.
-  const array<GLfloat, 1 * 4> light_color = {
-    1.f, 1.f, 1.f, 1.f }; // Field: light_diffuse_color.
-  light_color_ubo.reset(new UniformBuffer(
-    light_color.size() * sizeof(GLfloat), light_color.data()));
-  bindUniformBuffer(*phong_yuv, "LightColor", *light_color_ubo);
-
-  // Light direction.
-  const array<GLfloat, 1 * 4> light_direction = {
-    0.f, 0.f, -1.f, 1.f }; // Field: light_direction.
-  light_direction_ubo.reset(new UniformBuffer(
-    light_direction.size() * sizeof(GLfloat), light_direction.data()));
-  bindUniformBuffer(*phong_yuv, "LightDirection", *light_direction_ubo);
-
-  // Material.
-  const array<GLfloat, 1 * 4> material = {
-    1.f, 1.f, 1.f, 1.f, // Field: front_diffuse.
-  };
-  material_ubo.reset(new UniformBuffer(
-    material.size() * sizeof(GLfloat), material.data()));
-  bindUniformBuffer(*phong_yuv, "Material", *material_ubo);
-
-  // Model.
-  const array<GLfloat, 2 * 16> model = {
-    1.f, 0.f, 0.f, 0.f, // Field: world_from_obj matrix, column 0.
-    0.f, 1.f, 0.f, 0.f,
-    0.f, 0.f, 1.f, 0.f,
-    0.f, 0.f, 0.f, 1.f,
-    1.f, 0.f, 0.f, 0.f, // Field: world_from_obj_normal, column 0.
-    0.f, 1.f, 0.f, 0.f,
-    0.f, 0.f, 1.f, 0.f,
-    0.f, 0.f, 0.f, 1.f };
-  model_ubo.reset(new UniformBuffer(
-    model.size() * sizeof(GLfloat), model.data()));
-  bindUniformBuffer(*phong_yuv, "Model", *model_ubo);
-
-  // ----------------------
-  // Initialize attributes.
-  // ----------------------
+  MeshData()
+    : obj_pos_data(nullptr), yuv_data(nullptr), tri_index_data(nullptr),
+      face_normal_data(nullptr), vertex_count(0), triangle_count(0) {}
 
+  unique_ptr<MeshCacheFile> cache_file; // Set on a cache hit.
   vector<Vec3f> obj_pos;
   vector<Vec3f> yuv;
   vector<Triangle> tri_index;
-  makeMesh(x_min, y_min, z_min,
-           x_max, y_max, z_max,
-           u_min, u_max,
-           v_min, v_max,
-           radius, seed,
-           &obj_pos, &yuv, &tri_index);
-  //writeObj("mesh.obj", obj_pos, tri_index); // TMP!!
+  vector<Vec3f> face_normal; // One per triangle.
+  vector<MeshLevel> levels; // Finest first, see makeMesh().
+
+  // Point into the vectors or the cache file mapping.
+  const Vec3f* obj_pos_data;
+  const Vec3f* yuv_data;
+  const Triangle* tri_index_data;
+  const Vec3f* face_normal_data;
+  size_t vertex_count;
+  size_t triangle_count;
+};
 
+//! Returns the mesh for params. Meshes are cached on disk keyed by their
+//! parameters; a hit maps the file so that the upload reads straight from
+//! the mapping. Safe to run on a worker thread, it makes no GL calls.
+unique_ptr<MeshData> loadMesh(const MeshParams& params)
+{
+  unique_ptr<MeshData> mesh(new MeshData);
+  const uint64_t mesh_key = meshParamsKey(params);
+  const string mesh_filename =
+    MeshCacheFile::filename(kMeshCacheDirectory, mesh_key);
+  mesh->cache_file.reset(new MeshCacheFile(
+    mesh_filename, mesh_key, sizeof(Vec3f), sizeof(Triangle)));
+  if (mesh->cache_file->valid()) {
+    cout << "mesh cache hit: " << mesh_filename << endl;
+    mesh->obj_pos_data = mesh->cache_file->objPos<Vec3f>();
+    mesh->yuv_data = mesh->cache_file->yuv<Vec3f>();
+    mesh->tri_index_data = mesh->cache_file->triIndex<Triangle>();
+    mesh->face_normal_data = mesh->cache_file->faceNormal<Vec3f>();
+    mesh->vertex_count = mesh->cache_file->vertexCount();
+    mesh->triangle_count = mesh->cache_file->triangleCount();
+    mesh->levels = mesh->cache_file->levels();
+    return mesh;
+  }
+  mesh->cache_file.reset();
+
+  makeMesh(params, &mesh->obj_pos, &mesh->yuv, &mesh->tri_index,
+           &mesh->face_normal, &mesh->levels);
+  //writeObj("mesh.obj", mesh->obj_pos, mesh->tri_index); // TMP!!
+  if (!MeshCacheFile::write(mesh_filename, mesh_key,
+                            mesh->obj_pos, mesh->yuv, mesh->tri_index,
+                            mesh->face_normal, mesh->levels)) {
+    cerr << "Warning: could not write mesh cache " << mesh_filename << endl;
+  }
+  mesh->obj_pos_data = mesh->obj_pos.data();
+  mesh->yuv_data = mesh->yuv.data();
+  mesh->tri_index_data = mesh->tri_index.data();
+  mesh->face_normal_data = mesh->face_normal.data();
+  mesh->vertex_count = mesh->obj_pos.size();
+  mesh->triangle_count = mesh->tri_index.size();
+  return mesh;
+}
+
+// Mesh being built on a worker thread, then uploaded over several frames.
+future<unique_ptr<MeshData>> mesh_future;
+unique_ptr<MeshData> pending_mesh;
+size_t pending_mesh_offset = 0; // Bytes uploaded from pending_mesh.
+
+// Pyramid of the uploaded mesh, and the spacing of level 0 relative to the
+// mesh width, for picking a level by framebuffer size.
+vector<MeshLevel> mesh_levels;
+GLfloat mesh_relative_spacing = 0.f;
+int bench_mesh_level = -1; // Overrides selectMeshLevel() if not negative.
+
+//! Allocates the mesh buffers. The data is copied by continueMeshUpload().
+void beginMeshUpload(unique_ptr<MeshData> mesh)
+{
+  // Deletes vertex arrays and creates buffers, which binds them.
+  const GlStateCache::Bypass gl_state_bypass(gl_state);
+  phong_yuv_va.reset();
+  phong_yuv_flat_va.reset();
+  phong_yuv_gbuffer_va.reset();
+  phong_yuv_planar_va.reset();
   obj_pos_vbo.reset(new ArrayBuffer(
-    obj_pos.size() * sizeof(Vec3f), &obj_pos[0]));
+    mesh->vertex_count * sizeof(Vec3f), nullptr));
   yuv_vbo.reset(new ArrayBuffer(
-    yuv.size() * sizeof(Vec3f), &yuv[0]));
+    mesh->vertex_count * sizeof(Vec3f), nullptr));
   tri_index_ibo.reset(new ElementArrayBuffer(
-    tri_index.size() * sizeof(Triangle), &tri_index[0]));
+    mesh->triangle_count * sizeof(Triangle), nullptr));
+  face_normal_buf.reset(new ArrayBuffer(
+    mesh->triangle_count * sizeof(Vec3f), nullptr));
+  mesh_levels = mesh->levels;
+  pending_mesh = move(mesh);
+  pending_mesh_offset = 0;
+}
 
+//! Vertex array for drawing the mesh buffers with program.
+unique_ptr<VertexArray> makeMeshVertexArray(
+  const CachedShaderProgram& program)
+{
   // Create vertex array to "remember" bindings.
-  phong_yuv_va.reset(new VertexArray);
-  phong_yuv_va->bind();
+  unique_ptr<VertexArray> va(new VertexArray);
+  va->bind();
 
   // Bind obj_pos attribute.
-  const Attrib obj_pos_attrib = phong_yuv->activeAttrib("obj_pos");
+  const CachedShaderProgram::Attrib obj_pos_attrib =
+    program.activeAttrib("obj_pos");
   const Bindor<ArrayBuffer> obj_pos_vbo_bindor(*obj_pos_vbo);
   const VertexAttribArrayEnabler obj_pos_vaae(obj_pos_attrib.location);
   vertexAttribPointer(
@@ -550,7 +1224,8 @@ void initScene()
     0);       // Read from currently bound VBO.
 
   // Bind yuv attribute.
-  const Attrib* yuv_attrib = phong_yuv->queryActiveAttrib("yuv");
+  const CachedShaderProgram::Attrib* yuv_attrib =
+    program.queryActiveAttrib("yuv");
   const Bindor<ArrayBuffer> yuv_vbo_bindor(*yuv_vbo);
   const VertexAttribArrayEnabler yuv_vaae(yuv_attrib->location);
   vertexAttribPointer(
@@ -563,7 +1238,70 @@ void initScene()
 
   // Bind triangle indices.
   const Bindor<ElementArrayBuffer> tri_index_bindor(*tri_index_ibo);
-  phong_yuv_va->release();
+  va->release();
+  return va;
+}
+
+//! Allocates the bin buffers of the compute rasterizer for the uploaded
+//! mesh, then binds them, the mesh buffers, rgb_tex and raster_owner_tex
+//! to the binding points of raster_common.glsl. Nothing else uses those
+//! binding points.
+void bindComputeRasterBuffers()
+{
+  if (!raster_bin) {
+    return;
+  }
+  const size_t triangle_count = tri_index_ibo->sizeInBytes() / sizeof(Triangle);
+  const size_t tiles_x = (fbo_width + kRasterTileSize - 1) / kRasterTileSize;
+  const size_t tiles_y = (fbo_height + kRasterTileSize - 1) / kRasterTileSize;
+  raster_tile_range_buf.reset(new ArrayBuffer(
+    2 * tiles_x * tiles_y * sizeof(GLuint), nullptr));
+  // A binned triangle overlaps at most 2x2 tiles.
+  raster_tile_triangle_buf.reset(new ArrayBuffer(
+    4 * triangle_count * sizeof(GLuint), nullptr));
+  // Dispatch arguments and count, then the triangle list.
+  raster_large_buf.reset(new ArrayBuffer(
+    (4 + triangle_count) * sizeof(GLuint), nullptr));
+  if (!raster_owner_tex) {
+    raster_owner_tex.reset(new Texture2D(
+      GL_TEXTURE_2D, fbo_width, fbo_height, 0, GL_R32UI,
+      0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr));
+  }
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, obj_pos_vbo->handle());
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, yuv_vbo->handle());
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, tri_index_ibo->handle());
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3,
+                   raster_tile_range_buf->handle());
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4,
+                   raster_tile_triangle_buf->handle());
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, raster_large_buf->handle());
+  glBindImageTexture(0, rgb_tex->handle(), 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                     GL_RGBA8);
+  glBindImageTexture(1, raster_owner_tex->handle(), 0, GL_FALSE, 0,
+                     GL_READ_WRITE, GL_R32UI);
+  GL_CHECK("glBindImageTexture");
+}
+
+//! Creates the vertex arrays once all mesh buffers are filled.
+void bindMeshVertexArray()
+{
+  const GlStateCache::Bypass gl_state_bypass(gl_state);
+  phong_yuv_va = makeMeshVertexArray(*phong_yuv);
+  phong_yuv_flat_va = makeMeshVertexArray(*phong_yuv_flat);
+  phong_yuv_gbuffer_va = makeMeshVertexArray(*phong_yuv_gbuffer);
+  phong_yuv_planar_va = makeMeshVertexArray(*phong_yuv_planar);
+
+  // Face normals, fetched by gl_PrimitiveID in phong_yuv_flat.fs.
+  if (face_normal_tex == 0) {
+    glGenTextures(1, &face_normal_tex);
+  }
+  glBindTexture(GL_TEXTURE_BUFFER, face_normal_tex);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, face_normal_buf->handle());
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  GL_CHECK("glTexBuffer");
+
+  bindComputeRasterBuffers();
 
 #if 1
   cout << "obj_pos count: "
@@ -573,16 +1311,221 @@ void initScene()
        << yuv_vbo->sizeInBytes() / sizeof(Vec3f)
        << endl
        << "tri_index count: "
-       << 3 * (tri_index_ibo->sizeInBytes() / sizeof(Vec3us))
+       << 3 * (tri_index_ibo->sizeInBytes() / sizeof(Triangle))
        << endl
        << "triangle count: "
-       << tri_index_ibo->sizeInBytes() / sizeof(Vec3us)
+       << tri_index_ibo->sizeInBytes() / sizeof(Triangle)
        << endl;
 #endif
 }
 
+//! Copies at most max_bytes of the pending mesh into its buffers. Returns
+//! true when the upload is complete and the mesh can be drawn.
+bool continueMeshUpload(const size_t max_bytes)
+{
+  assert(pending_mesh);
+  const size_t vertex_bytes = pending_mesh->vertex_count * sizeof(Vec3f);
+  const size_t triangle_bytes = pending_mesh->triangle_count * sizeof(Triangle);
+  const size_t face_bytes = pending_mesh->triangle_count * sizeof(Vec3f);
+  const struct {
+    GLuint handle;
+    const void* data;
+    size_t size;
+  } regions[] = {
+    { obj_pos_vbo->handle(), pending_mesh->obj_pos_data, vertex_bytes },
+    { yuv_vbo->handle(), pending_mesh->yuv_data, vertex_bytes },
+    { tri_index_ibo->handle(), pending_mesh->tri_index_data, triangle_bytes },
+    { face_normal_buf->handle(), pending_mesh->face_normal_data, face_bytes }
+  };
+
+  // Copy through GL_COPY_WRITE_BUFFER, which unlike
+  // GL_ELEMENT_ARRAY_BUFFER is not vertex array state.
+  size_t budget = max_bytes;
+  size_t region_begin = 0;
+  for (size_t r = 0; r < 4 && budget > 0; ++r) {
+    const size_t region_end = region_begin + regions[r].size;
+    if (pending_mesh_offset < region_end) {
+      const size_t offset = pending_mesh_offset - region_begin;
+      const size_t size = min(budget, regions[r].size - offset);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, regions[r].handle);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size,
+                      static_cast<const uint8_t*>(regions[r].data) + offset);
+      GL_CHECK("glBufferSubData");
+      pending_mesh_offset += size;
+      budget -= size;
+    }
+    region_begin = region_end;
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  if (pending_mesh_offset < 2 * vertex_bytes + triangle_bytes + face_bytes) {
+    return false;
+  }
+  bindMeshVertexArray();
+  pending_mesh.reset(); // Releases the arrays or the cache file mapping.
+  scene_dirty = true;
+  gbuffer_dirty = true;
+  return true;
+}
+
+//! Advances the mesh build without blocking: starts the upload once the
+//! worker is done and then uploads one slice per call. Returns true on the
+//! call that completes the upload.
+bool updateMesh()
+{
+  if (mesh_future.valid() &&
+      mesh_future.wait_for(chrono::seconds(0)) == future_status::ready) {
+    beginMeshUpload(mesh_future.get());
+  }
+  return pending_mesh && continueMeshUpload(kMeshUploadBytesPerFrame);
+}
+
+//! Blocks until the mesh is built and uploaded.
+void finishMesh()
+{
+  if (mesh_future.valid()) {
+    beginMeshUpload(mesh_future.get());
+  }
+  if (pending_mesh) {
+    continueMeshUpload(numeric_limits<size_t>::max());
+  }
+}
+
+//! Camera uniform block contents: identity view_from_world and an
+//! orthographic clip_from_view for the given box. The depth range is
+//! widened by the --animate z amplitude, so the graphics pipeline does not
+//! clip the vertices the animation pushes out of the box.
+array<GLfloat, 2 * 16> cameraData(const GLfloat x_min, const GLfloat x_max,
+                                  const GLfloat y_min, const GLfloat y_max,
+                                  const GLfloat z_min, const GLfloat z_max)
+{
+  array<GLfloat, 2 * 16> camera = {
+    1.f, 0.f, 0.f, 0.f, // view_from_world matrix, column 0.
+    0.f, 1.f, 0.f, 0.f,
+    0.f, 0.f, 1.f, 0.f,
+    0.f, 0.f, 0.f, 1.f,
+    1.f, 0.f, 0.f, 0.f, // clip_from_view, column 0.
+    0.f, 1.f, 0.f, 0.f,
+    0.f, 0.f, 1.f, 0.f,
+    0.f, 0.f, 0.f, 1.f };
+  const GLfloat z_slack = std::abs(options.animate_z);
+  makeOrthographicProjectionMatrix(
+    x_min, x_max,
+    y_min, y_max,
+    z_min - z_slack, z_max + z_slack,
+    &camera[16]);
+  return camera;
+}
+
+//! Animation uniform block contents, see phong_yuv.vs.
+struct AnimationData
+{
+  GLfloat time;
+  GLfloat z_amplitude;
+  GLfloat frequency;
+  GLuint seed;
+  GLfloat uv_amplitude[4];
+};
+
+AnimationData animationData(const GLfloat time)
+{
+  const AnimationData animation = {
+    time, options.animate_z, kAnimationKeysPerSecond, options.seed,
+    { options.animate_u, options.animate_v, 0.f, 0.f } };
+  return animation;
+}
+
+void initScene()
+{
+  const GLfloat x_min = -10.f;
+  const GLfloat y_min = -10.f;
+  const GLfloat z_min = -1.f;
+  const GLfloat x_max = 10.f;
+  const GLfloat y_max = 10.f;
+  const GLfloat z_max = 1.f;
+  const GLfloat u_min = -0.436f;
+  const GLfloat u_max =  0.436f;
+  const GLfloat v_min = -0.615f;
+  const GLfloat v_max =  0.615f;
+  const GLfloat radius = options.radius;
+  const uint32_t seed = options.seed;
+
+  // --------------------------
+  // Initialize uniform blocks.
+  // --------------------------
+
+  uniforms.reset(new UniformArena(kUniformArenaCapacity, kUniformArenaRegions));
+
+  // Camera.
+  scene_extent = { x_min, x_max, y_min, y_max, z_min, z_max };
+  const array<GLfloat, 2 * 16> camera =
+    cameraData(x_min, x_max, y_min, y_max, z_min, z_max);
+  camera_block = makeUniformBlock(
+    *phong_yuv, "Camera", camera.data(), camera.size() * sizeof(GLfloat));
+
+  // Light color.
+  const array<GLfloat, 1 * 4> light_color = {
+    1.f, 1.f, 1.f, 1.f }; // Field: light_diffuse_color.
+  light_color_block = makeUniformBlock(
+    *phong_yuv, "LightColor", light_color.data(), light_color.size() * sizeof(GLfloat));
+
+  // Light direction.
+  const array<GLfloat, 1 * 4> light_direction = {
+    0.f, 0.f, -1.f, 1.f }; // Field: light_direction.
+  light_direction_block = makeUniformBlock(
+    *phong_yuv, "LightDirection", light_direction.data(), light_direction.size() * sizeof(GLfloat));
+
+  // Material.
+  const array<GLfloat, 1 * 4> material = {
+    1.f, 1.f, 1.f, 1.f, // Field: front_diffuse.
+  };
+  material_block = makeUniformBlock(
+    *phong_yuv, "Material", material.data(), material.size() * sizeof(GLfloat));
+
+  // Model.
+  const array<GLfloat, 2 * 16> model = {
+    1.f, 0.f, 0.f, 0.f, // Field: world_from_obj matrix, column 0.
+    0.f, 1.f, 0.f, 0.f,
+    0.f, 0.f, 1.f, 0.f,
+    0.f, 0.f, 0.f, 1.f,
+    1.f, 0.f, 0.f, 0.f, // Field: world_from_obj_normal, column 0.
+    0.f, 1.f, 0.f, 0.f,
+    0.f, 0.f, 1.f, 0.f,
+    0.f, 0.f, 0.f, 1.f };
+  model_block = makeUniformBlock(
+    *phong_yuv, "Model", model.data(), model.size() * sizeof(GLfloat));
+
+  // Animation.
+  const AnimationData animation = animationData(0.f);
+  animation_block = makeUniformBlock(
+    *phong_yuv, "Animation", &animation, sizeof(animation));
+
+  // ----------------------
+  // Initialize attributes.
+  // ----------------------
+
+  // The mesh is built on a worker thread while the main loop keeps
+  // running; see updateMesh().
+  const MeshParams mesh_params = { options.mesh_mode,
+                                   x_min, y_min, z_min,
+                                   x_max, y_max, z_max,
+                                   u_min, u_max,
+                                   v_min, v_max,
+                                   radius, seed,
+                                   options.radius_min,
+                                   options.importance_filename,
+                                   options.jitter,
+                                   options.levels };
+  scene_mesh_params = mesh_params;
+  mesh_relative_spacing = radius / (x_max - x_min);
+  if (options.batch_size == 0) {
+    mesh_future = async(launch::async, loadMesh, mesh_params);
+  }
+}
+
 void initScreen()
 {
+  const GlStateCache::Bypass gl_state_bypass(gl_state);
   // --------------------------
   // Initialize uniform blocks.
   // --------------------------
@@ -602,9 +1545,8 @@ void initScreen()
     -1.f, 1.f,
     -1.f, 1.f,
     &camera[16]);
-  screen_tex_camera_ubo.reset(new UniformBuffer(
-    camera.size() * sizeof(GLfloat), camera.data()));
-  bindUniformBuffer(*screen_tex, "Camera", *screen_tex_camera_ubo);
+  screen_tex_camera_block = makeUniformBlock(
+    *screen_tex, "Camera", camera.data(), camera.size() * sizeof(GLfloat));
 
   // Model.
   const array<GLfloat, 1 * 16> model = {
@@ -612,9 +1554,8 @@ void initScreen()
     0.f, 1.f, 0.f, 0.f,
     0.f, 0.f, 1.f, 0.f,
     0.f, 0.f, 0.f, 1.f };
-  screen_tex_model_ubo.reset(new UniformBuffer(
-    model.size() * sizeof(GLfloat), model.data()));
-  bindUniformBuffer(*screen_tex, "Model", *screen_tex_model_ubo);
+  screen_tex_model_block = makeUniformBlock(
+    *screen_tex, "Model", model.data(), model.size() * sizeof(GLfloat));
 
   // ----------------------
   // Initialize attributes.
@@ -648,7 +1589,8 @@ void initScreen()
   screen_tex_va->bind();
 
   // Bind obj_pos attribute.
-  const Attrib obj_pos_attrib = screen_tex->activeAttrib("obj_pos");
+  const CachedShaderProgram::Attrib obj_pos_attrib =
+    screen_tex->activeAttrib("obj_pos");
   const Bindor<ArrayBuffer> obj_pos_vbo_bindor(*screen_tex_obj_pos_vbo);
   const VertexAttribArrayEnabler obj_pos_vaae(obj_pos_attrib.location);
   vertexAttribPointer(
@@ -660,7 +1602,8 @@ void initScreen()
     nullptr); // Read from currently bound VBO.
 
   // Bind uv attribute.
-  const Attrib* uv_attrib = screen_tex->queryActiveAttrib("uv");
+  const CachedShaderProgram::Attrib* uv_attrib =
+    screen_tex->queryActiveAttrib("uv");
   const Bindor<ArrayBuffer> uv_vbo_bindor(*screen_tex_uv_vbo);
   const VertexAttribArrayEnabler uv_vaae(uv_attrib->location);
   vertexAttribPointer(
@@ -676,97 +1619,1111 @@ void initScreen()
   screen_tex_va->release();
 }
 
-void drawScene()
+//! Returns the finest pyramid level whose vertex spacing is at least
+//! kMinSpacingPixels at the given framebuffer width. Spacing doubles per
+//! level; the coarsest level is used if none is coarse enough.
+const MeshLevel& selectMeshLevel(const GLsizei width)
+{
+  assert(!mesh_levels.empty());
+  if (bench_mesh_level >= 0) {
+    return mesh_levels[bench_mesh_level];
+  }
+  GLfloat spacing_pixels = mesh_relative_spacing * width;
+  size_t level = 0;
+  while (spacing_pixels < kMinSpacingPixels &&
+         level + 1 < mesh_levels.size()) {
+    spacing_pixels *= 2.f;
+    ++level;
+  }
+  return mesh_levels[level];
+}
+
+//! Mean area in pixels of the triangles drawn into the FBO, which the mesh
+//! covers.
+GLfloat meanTriangleArea()
 {
-  const Bindor<ShaderProgram> phong_yuv_bindor(*phong_yuv);
-  const Bindor<VertexArray> phong_yuv_va_bindor(*phong_yuv_va);
+  const MeshLevel& level = selectMeshLevel(fbo_width);
+  return static_cast<GLfloat>(fbo_width) * fbo_height /
+         max<uint64_t>(level.triangle_count, 1);
+}
 
+//! True if renderTexture() should use renderTextureCompute(): always with
+//! --raster=compute, by default if the triangles are small enough for it
+//! to win. Needs an uploaded mesh and GL 4.3, without which
+//! buildShaderPrograms() rejects --raster=compute. The default keeps the
+//! graphics pipeline for the flat pipeline and the vertex animation, which
+//! the compute path does not implement, and --deferred always uses it.
+bool useComputeRaster()
+{
+  if (!raster_bin || !phong_yuv_va || options.deferred) {
+    return false;
+  }
+  if (options.raster_mode != kAutoRaster) {
+    return options.raster_mode == kComputeRaster;
+  }
+  return !options.flat_pipeline && !animating() &&
+         meanTriangleArea() < kComputeRasterMaxArea;
+}
+
+//! Draws the mesh level for the FBO size with program, whose vertex array
+//! is va. flat must be set for phong_yuv_flat, which needs the face
+//! normals bound.
+void drawMesh(CachedShaderProgram& program, VertexArray& va, const bool flat)
+{
+  gl_state.useProgram(program.handle());
+  gl_state.bindVertexArray(va.handle());
+
+  const MeshLevel& level = selectMeshLevel(fbo_width);
+  if (flat) {
+    // Face normals of the level start at its first triangle.
+    glUniform1i(glGetUniformLocation(program.handle(), "primitive_offset"),
+                static_cast<GLint>(level.triangle_offset));
+    gl_state.bindTexture(GL_TEXTURE0, GL_TEXTURE_BUFFER, face_normal_tex);
+  }
   const GLuint min_index = 0;
-  const GLuint max_index = (obj_pos_vbo->sizeInBytes() / sizeof(Vec3f)) - 1;
-  const GLsizei index_count = 3 * tri_index_ibo->sizeInBytes() / sizeof(Vec3us);
+  const GLuint max_index = static_cast<GLuint>(level.vertex_count) - 1;
+  const GLsizei index_count = static_cast<GLsizei>(3 * level.triangle_count);
   drawRangeElements(
     GL_TRIANGLES,
     min_index,
     max_index,
     index_count,
-    GLTypeEnum<GLushort>::value,
-    nullptr); // Read indices from currently bound element array.
+    GLTypeEnum<GLuint>::value,
+    reinterpret_cast<const GLvoid*>(  // Offset into bound element array.
+      level.triangle_offset * sizeof(Triangle)));
+}
+
+void drawScene()
+{
+  const PassProfiler::Scope profile(profiler.get(), "drawScene");
+  if (!phong_yuv_va) {
+    return; // Mesh not uploaded yet, leave the clear color as placeholder.
+  }
+  if (options.deferred) {
+    drawMesh(*phong_yuv_gbuffer, *phong_yuv_gbuffer_va, false);
+  }
+  else if (options.flat_pipeline) {
+    drawMesh(*phong_yuv_flat, *phong_yuv_flat_va, true);
+  }
+  else {
+    drawMesh(*phong_yuv, *phong_yuv_va, false);
+  }
+}
+
+//! Renders the mesh as full-range BT.601 YCbCr: Y and full resolution
+//! Cb Cr in one pass with two render targets, then Cb Cr downsampled 2x2
+//! into cbcr_tex for 4:2:0 output.
+void renderPlanarYuv()
+{
+  const PassProfiler::Scope profile(profiler.get(), "renderPlanarYuv");
+  gl_state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, planar_fbo->handle());
+  gl_state.viewport(0, 0, fbo_width, fbo_height);
+  array<GLenum, 2> draw_bufs = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+  gl_state.drawBuffers(draw_bufs);
+  array<GLfloat, 4> clear_color = { .5f, .5f, .5f, 1.f }; // Gray as YCbCr.
+  clearBufferfv(GL_COLOR, 0, clear_color.data());
+  clearBufferfv(GL_COLOR, 1, clear_color.data());
+  if (phong_yuv_planar_va) {
+    drawMesh(*phong_yuv_planar, *phong_yuv_planar_va, false);
+  }
+
+  gl_state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, chroma_fbo->handle());
+  gl_state.viewport(0, 0, (fbo_width + 1) / 2, (fbo_height + 1) / 2);
+  array<GLenum, 1> chroma_bufs = { GL_COLOR_ATTACHMENT0 };
+  gl_state.drawBuffers(chroma_bufs);
+  gl_state.useProgram(chroma_downsample->handle());
+  gl_state.bindVertexArray(deferred_va->handle());
+  gl_state.bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, cbcr_full_tex->handle());
+  glDrawArrays(GL_TRIANGLES, 0, 3); // Full-screen triangle.
+  GL_CHECK("glDrawArrays");
 }
 
 void drawScreen()
 {
-  activeTexture(GL_TEXTURE0);
-  const Bindor<ShaderProgram> screen_tex_bindor(*screen_tex);
-  const Bindor<VertexArray> screen_tex_va_bindor(*screen_tex_va);
-  const TextureBindor<Texture2D> tex_bindor(GL_TEXTURE_2D, *rgb_tex);
+  gl_state.useProgram(screen_tex->handle());
+  gl_state.bindVertexArray(screen_tex_va->handle());
+  gl_state.bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, rgb_tex->handle());
 
   const GLuint min_index = 0;
   const GLuint max_index =
     (screen_tex_obj_pos_vbo->sizeInBytes() / sizeof(Vec3f)) - 1;
   const GLsizei index_count =
-    3 * screen_tex_tri_ibo->sizeInBytes() / sizeof(Vec3us);
+    3 * screen_tex_tri_ibo->sizeInBytes() / sizeof(Triangle);
   drawRangeElements(
     GL_TRIANGLES,
     min_index,
     max_index,
     index_count,
-    GLTypeEnum<GLushort>::value,
+    GLTypeEnum<GLuint>::value,
     nullptr); // Read indices from currently bound element array.
 }
 
+//! Deferred path of renderTexture(): rasterizes the mesh into the G-buffer
+//! attachments of fbo if the mesh changed, then lights every pixel with a
+//! full-screen pass into the color attachment. Light and material changes
+//! only cost the full-screen pass.
+void renderTextureDeferred()
+{
+  gl_state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo->handle());
+  gl_state.viewport(0, 0, fbo_width, fbo_height);
+  if (gbuffer_dirty) {
+    array<GLenum, 2> gbuffer_bufs = {
+      GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    gl_state.drawBuffers(gbuffer_bufs);
+    array<GLfloat, 4> empty = { 0.f, 0.f, 0.f, 0.f };
+    clearBufferfv(GL_COLOR, 0, empty.data());
+    clearBufferfv(GL_COLOR, 1, empty.data());
+    drawScene();
+    gbuffer_dirty = !phong_yuv_va; // Placeholder until the mesh is up.
+  }
+
+  array<GLenum, 1> draw_bufs = { GL_COLOR_ATTACHMENT0 };
+  gl_state.drawBuffers(draw_bufs);
+  array<GLfloat, 4> clear_color = { .5f, .5f, .5f, 1.f };
+  clearBufferfv(GL_COLOR, 0, clear_color.data());
+  gl_state.useProgram(deferred_phong_yuv->handle());
+  gl_state.bindVertexArray(deferred_va->handle());
+  gl_state.bindTexture(GL_TEXTURE0, GL_TEXTURE_2D,
+                       gbuffer_normal_tex->handle());
+  gl_state.bindTexture(GL_TEXTURE1, GL_TEXTURE_2D, gbuffer_yuv_tex->handle());
+  glDrawArrays(GL_TRIANGLES, 0, 3); // Full-screen triangle.
+  GL_CHECK("glDrawArrays");
+}
+
+//! Compute path of renderTexture(): bins the triangles of the mesh level
+//! into kRasterTileSize screen tiles, shades each tile in one work group
+//! and writes rgb_tex as an image. Tiny triangles waste most of the
+//! graphics pipeline on per-triangle setup in the geometry shader and on
+//! partially covered 2x2 pixel quads; here each triangle is set up once per
+//! tile it touches and each pixel is written once. Same shading, culling
+//! and fill rule as phong_yuv, except that triangles crossing the near or
+//! far plane are dropped rather than clipped, see raster_common.glsl.
+void renderTextureCompute()
+{
+  const PassProfiler::Scope profile(profiler.get(), "renderTextureCompute");
+  const MeshLevel& level = selectMeshLevel(fbo_width);
+  const GLint tiles_x = (fbo_width + kRasterTileSize - 1) / kRasterTileSize;
+  const GLint tiles_y = (fbo_height + kRasterTileSize - 1) / kRasterTileSize;
+  const GLuint triangle_count = static_cast<GLuint>(level.triangle_count);
+  const GLuint bin_groups = (triangle_count + 63) / 64; // Local size 64.
+
+  // Zero the tile counts, the large triangle count and its dispatch size.
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, raster_tile_range_buf->handle());
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                    GL_UNSIGNED_INT, nullptr);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, raster_large_buf->handle());
+  glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0,
+                       4 * sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT,
+                       nullptr);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  GL_CHECK("glClearBufferData");
+
+  const auto useRasterProgram =
+    [tiles_x, tiles_y](const CachedShaderProgram& program) {
+    gl_state.useProgram(program.handle());
+    glUniform2i(glGetUniformLocation(program.handle(), "tiles"),
+                tiles_x, tiles_y);
+  };
+  const GLuint bin = raster_bin->handle();
+
+  // Count the triangles per tile, then turn the counts into offsets.
+  useRasterProgram(*raster_bin);
+  glUniform1ui(glGetUniformLocation(bin, "triangle_offset"),
+               static_cast<GLuint>(level.triangle_offset));
+  glUniform1ui(glGetUniformLocation(bin, "triangle_count"), triangle_count);
+  glUniform1i(glGetUniformLocation(bin, "fill_pass"), GL_FALSE);
+  glDispatchCompute(bin_groups, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  useRasterProgram(*raster_scan);
+  glDispatchCompute(1, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+  // Fill the tile lists.
+  useRasterProgram(*raster_bin);
+  glUniform1i(glGetUniformLocation(bin, "fill_pass"), GL_TRUE);
+  glDispatchCompute(bin_groups, 1, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  // Shade the tiles, then the triangles too large to bin on top: claim
+  // their pixels in raster_owner_tex, then shade the pixels they kept.
+  useRasterProgram(*raster_tile);
+  array<GLfloat, 4> clear_color = { .5f, .5f, .5f, 1.f };
+  glUniform4fv(glGetUniformLocation(raster_tile->handle(), "clear_color"),
+               1, clear_color.data());
+  glDispatchCompute(tiles_x, tiles_y, 1);
+  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  useRasterProgram(*raster_large);
+  const GLint resolve_pass =
+    glGetUniformLocation(raster_large->handle(), "resolve_pass");
+  glUniform1i(resolve_pass, GL_FALSE);
+  glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, raster_large_buf->handle());
+  glDispatchComputeIndirect(0);
+  glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  glUniform1i(resolve_pass, GL_TRUE);
+  glDispatchComputeIndirect(0);
+  glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+  GL_CHECK("glDispatchComputeIndirect");
+
+  // rgb_tex is next read through fbo or as a texture.
+  glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
 void renderTexture()
 {
-  fbo->bind(GL_DRAW_FRAMEBUFFER);
-  viewport(0, 0, fbo_width, fbo_height);
+  const PassProfiler::Scope profile(profiler.get(), "renderTexture");
+  if (options.deferred) {
+    renderTextureDeferred();
+    return;
+  }
+  if (useComputeRaster()) {
+    renderTextureCompute();
+    return;
+  }
+  gl_state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo->handle());
+  gl_state.viewport(0, 0, fbo_width, fbo_height);
   array<GLenum, 1> draw_bufs = { GL_COLOR_ATTACHMENT0 };
-  drawBuffers(draw_bufs);
+  gl_state.drawBuffers(draw_bufs);
   array<GLfloat, 4> clear_color = { .5f, .5f, .5f, 1.f };
   clearBufferfv(GL_COLOR, 0, clear_color.data());
   drawScene();
-  fbo->release(GL_DRAW_FRAMEBUFFER);
+}
+
+//! Copies the FBO to the window, scaled to fill it. Replaces drawScreen()
+//! when no effect needs the screen_tex shader.
+void blitScreen()
+{
+  gl_state.bindFramebuffer(GL_READ_FRAMEBUFFER, fbo->handle());
+  gl_state.readBuffer(GL_COLOR_ATTACHMENT0);
+  glBlitFramebuffer(0, 0, fbo_width, fbo_height,
+                    0, 0, win_width, win_height,
+                    GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  GL_CHECK("glBlitFramebuffer");
 }
 
 void renderScreen()
 {
-  viewport(0, 0, win_width, win_height);
+  const PassProfiler::Scope profile(profiler.get(), "renderScreen");
+  gl_state.bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
   array<GLenum, 1> draw_bufs = { GL_BACK };
-  drawBuffers(draw_bufs);
+  gl_state.drawBuffers(draw_bufs);
+  if (!options.quad_present) {
+    blitScreen();
+    return;
+  }
+  gl_state.viewport(0, 0, win_width, win_height);
   drawScreen();
 }
 
+//! Queues an asynchronous readback of the FBO, written to filename once
+//! the GPU is done. See PixelReadbackRing.
+void captureTexture(string const& filename)
+{
+  gl_state.bindFramebuffer(GL_READ_FRAMEBUFFER, fbo->handle());
+  gl_state.readBuffer(GL_COLOR_ATTACHMENT0);
+  //namedFramebufferReadBuffer(fbo->handle(), GL_COLOR_ATTACHMENT0);
+  const GLsizei width = fbo_width;
+  const GLsizei height = fbo_height;
+  readback->read(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE,
+                 sizeof(Pixel8ui),
+                 [=](const void* pixels) {
+                   // Straight from the mapped pack buffer.
+                   writePpm(filename, width, height,
+                            static_cast<const Pixel8ui*>(pixels));
+                 });
+}
+
 void writeTexture(string const& filename)
 {
-  vector<Pixel8ui> img(fbo_width * fbo_height);
-  fbo->bind(GL_READ_FRAMEBUFFER);
+  captureTexture(filename);
+  readback->finish();
+}
+
+//! Reads the planes rendered by renderPlanarYuv() straight into an NV12 or
+//! I420 file: 1.5 bytes per pixel, no conversion on the CPU.
+void writePlanarYuv(string const& filename, const OutputFormat format)
+{
+  assert(format == kNv12Output || format == kI420Output);
+  const GlStateCache::Bypass gl_state_bypass(gl_state);
+  const shared_ptr<ofstream> ofs = make_shared<ofstream>(
+    filename, ios_base::out | ios_base::binary | ios_base::trunc);
+  // Each plane is written at its own offset, so the file layout does not
+  // depend on the order the encoders run in. They run one at a time, so
+  // sharing the stream is safe.
+  const auto planeWriter = [ofs](const size_t offset, const size_t size) {
+    return [ofs, offset, size](const void* pixels) {
+      ofs->seekp(static_cast<streamoff>(offset));
+      ofs->write(static_cast<const char*>(pixels), size);
+    };
+  };
+  const GLsizei chroma_width = (fbo_width + 1) / 2;
+  const GLsizei chroma_height = (fbo_height + 1) / 2;
+  const size_t luma_size = static_cast<size_t>(fbo_width) * fbo_height;
+  const size_t chroma_size = static_cast<size_t>(chroma_width) * chroma_height;
+
+  planar_fbo->bind(GL_READ_FRAMEBUFFER);
   readBuffer(GL_COLOR_ATTACHMENT0);
-  //namedFramebufferReadBuffer(fbo->handle(), GL_COLOR_ATTACHMENT0);
-  readPixels(0, 0, fbo_width, fbo_height, GL_RGB, GL_UNSIGNED_BYTE,
-             reinterpret_cast<GLvoid*>(img.data()));
-  writePpm(filename, fbo_width, fbo_height, img);
-  fbo->release(GL_READ_FRAMEBUFFER);
+  readback->read(0, 0, fbo_width, fbo_height, GL_RED, GL_UNSIGNED_BYTE, 1,
+                 planeWriter(0, luma_size));
+  planar_fbo->release(GL_READ_FRAMEBUFFER);
+
+  chroma_fbo->bind(GL_READ_FRAMEBUFFER);
+  readBuffer(GL_COLOR_ATTACHMENT0);
+  if (format == kNv12Output) {
+    readback->read(0, 0, chroma_width, chroma_height, GL_RG,
+                   GL_UNSIGNED_BYTE, 2,
+                   planeWriter(luma_size, 2 * chroma_size));
+  }
+  else {
+    readback->read(0, 0, chroma_width, chroma_height, GL_RED,
+                   GL_UNSIGNED_BYTE, 1, planeWriter(luma_size, chroma_size));
+    readback->read(0, 0, chroma_width, chroma_height, GL_GREEN,
+                   GL_UNSIGNED_BYTE, 1,
+                   planeWriter(luma_size + chroma_size, chroma_size));
+  }
+  chroma_fbo->release(GL_READ_FRAMEBUFFER);
+  readback->finish();
+  cout << "wrote " << filename << " (" << fbo_width << "x" << fbo_height
+       << (format == kNv12Output ? " NV12" : " I420") << ")" << endl;
+}
+
+//! Times frames renders of the FBO with the geometry shader pipeline and
+//! the flat pipeline, waiting for the GPU after each batch. Both run on
+//! the graphics pipeline without --deferred, whatever --raster selects.
+void benchmarkPipelines(const uint32_t frames)
+{
+  const bool flat_pipeline = options.flat_pipeline;
+  const RasterMode raster_mode = options.raster_mode;
+  const bool deferred = options.deferred;
+  options.raster_mode = kHardwareRaster;
+  options.deferred = false;
+  const size_t triangle_count = selectMeshLevel(fbo_width).triangle_count;
+  for (int p = 0; p < 2; ++p) {
+    options.flat_pipeline = p == 1;
+    renderTexture(); // Warm up.
+    glFinish();
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (uint32_t f = 0; f < frames; ++f) {
+      renderTexture();
+    }
+    glFinish();
+    const double ms = chrono::duration<double, milli>(
+      chrono::steady_clock::now() - start).count() / frames;
+    cout << (options.flat_pipeline ? "flat (vs+fs)" : "geometry shader")
+         << ": " << ms << " ms per frame, "
+         << triangle_count / (ms * 1000.) << " Mtri/s" << endl;
+  }
+  options.flat_pipeline = flat_pipeline;
+  options.raster_mode = raster_mode;
+  options.deferred = deferred;
+  scene_dirty = true;
+}
+
+//! Times frames renders of the FBO with the graphics pipeline and the
+//! compute rasterizer at every mesh level, and reports the largest mean
+//! triangle area at which the compute rasterizer won. Use --levels for a
+//! range of areas; compare with kComputeRasterMaxArea.
+void benchmarkRaster(const uint32_t frames)
+{
+  if (!raster_bin) {
+    cout << "raster benchmark: compute shaders need OpenGL 4.3" << endl;
+    return;
+  }
+  const RasterMode raster_mode = options.raster_mode;
+  const auto msPerFrame = [frames]() {
+    renderTexture(); // Warm up.
+    glFinish();
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (uint32_t f = 0; f < frames; ++f) {
+      renderTexture();
+    }
+    glFinish();
+    return chrono::duration<double, milli>(
+      chrono::steady_clock::now() - start).count() / frames;
+  };
+  GLfloat crossover_area = 0.f;
+  for (size_t l = 0; l < mesh_levels.size(); ++l) {
+    bench_mesh_level = static_cast<int>(l);
+    options.raster_mode = kHardwareRaster;
+    const double hardware_ms = msPerFrame();
+    options.raster_mode = kComputeRaster;
+    const double compute_ms = msPerFrame();
+    const GLfloat area = meanTriangleArea();
+    cout << "level " << l << ": " << mesh_levels[l].triangle_count
+         << " triangles, " << area << " pixels per triangle, hardware "
+         << hardware_ms << " ms, compute " << compute_ms << " ms" << endl;
+    if (compute_ms < hardware_ms) {
+      crossover_area = max(crossover_area, area);
+    }
+  }
+  bench_mesh_level = -1;
+  options.raster_mode = raster_mode;
+  if (crossover_area > 0.f) {
+    cout << "compute rasterizer wins up to " << crossover_area;
+  }
+  else {
+    cout << "compute rasterizer never wins";
+  }
+  cout << " pixels per triangle, auto threshold " << kComputeRasterMaxArea
+       << endl;
+  scene_dirty = true;
+}
+
+//! Times frames presentations of the FBO through each present path,
+//! without swapping so vsync does not hide the difference.
+void benchmarkPresent(const uint32_t frames)
+{
+  const bool quad_present = options.quad_present;
+  for (int p = 0; p < 2; ++p) {
+    options.quad_present = p == 1;
+    renderScreen(); // Warm up.
+    glFinish();
+    gl_state.endFrame(); // Count the timed frames only.
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (uint32_t f = 0; f < frames; ++f) {
+      renderScreen();
+    }
+    glFinish();
+    const double ms = chrono::duration<double, milli>(
+      chrono::steady_clock::now() - start).count() / frames;
+    cout << (options.quad_present ? "quad present" : "blit present")
+         << ": " << ms << " ms per frame, "
+         << static_cast<double>(gl_state.issued()) / frames
+         << " state calls issued, "
+         << static_cast<double>(gl_state.skipped()) / frames
+         << " skipped per frame" << endl;
+  }
+  options.quad_present = quad_present;
+  screen_dirty = true;
+}
+
+//! Renders, and with a window presents, frames back to back with vsync off
+//! and reports the throughput of renderTexture(). Times bench_seconds, or
+//! bench_frames frames, after bench_warmup untimed frames.
+void benchmarkFrames()
+{
+  const auto frame = []() {
+    renderTexture();
+    if (win != nullptr) {
+      renderScreen();
+      glfwSwapBuffers(win);
+      glfwPollEvents();
+    }
+    gl_state.endFrame();
+  };
+
+  if (win != nullptr) {
+    glfwSwapInterval(0);
+  }
+  for (uint32_t f = 0; f < options.bench_warmup; ++f) {
+    frame();
+  }
+  glFinish();
+
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  const auto elapsedSeconds = [start]() {
+    return chrono::duration<double>(
+      chrono::steady_clock::now() - start).count();
+  };
+  uint64_t frames = 0;
+  while (options.bench_seconds > 0. ? elapsedSeconds() < options.bench_seconds
+                                    : frames < options.bench_frames) {
+    frame();
+    ++frames;
+  }
+  glFinish();
+  const double seconds = elapsedSeconds();
+  if (win != nullptr) {
+    glfwSwapInterval(1);
+  }
+
+  const double fps = frames / seconds;
+  const size_t triangle_count = selectMeshLevel(fbo_width).triangle_count;
+  const double pixel_count = static_cast<double>(fbo_width) * fbo_height;
+  cout << "benchmark: " << frames << " frames in " << seconds << " s, "
+       << fps << " frames/s, "
+       << triangle_count * fps * 1e-6 << " Mtri/s, "
+       << pixel_count * fps * 1e-6 << " Mpixel/s"
+       << (win != nullptr ? " (with present)" : "") << endl;
+  scene_dirty = true;
+}
+
+//! Renders the FBO for count light directions around the z axis, tilted by
+//! 30 degrees, and writes them as light-NNNN.ppm. With --deferred the mesh
+//! is rasterized once and each direction only costs the lighting pass.
+void renderLightSweep(const uint32_t count)
+{
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (uint32_t i = 0; i < count; ++i) {
+    const GLfloat angle = 6.2831853f * i / count;
+    const GLfloat tilt = 0.5235988f;
+    const array<GLfloat, 1 * 4> light_direction = {
+      cos(angle) * sin(tilt), sin(angle) * sin(tilt), -cos(tilt), 1.f };
+    updateUniformBlock(light_direction_block, light_direction.data());
+
+    renderTexture();
+    char filename[32];
+    snprintf(filename, sizeof(filename), "light-%04u.ppm", i);
+    captureTexture(filename);
+    readback->poll();
+  }
+  readback->finish();
+  const double ms = chrono::duration<double, milli>(
+    chrono::steady_clock::now() - start).count();
+  cout << "light sweep of " << count << (options.deferred ? " (deferred)" : "")
+       << ": " << ms / count << " ms per direction" << endl;
+
+  // Back to the initial light.
+  const array<GLfloat, 1 * 4> light_direction = { 0.f, 0.f, -1.f, 1.f };
+  updateUniformBlock(light_direction_block, light_direction.data());
+  scene_dirty = true;
+}
+
+//! Renders an output_width x output_height image in FBO sized tiles and
+//! streams them to filename, so the output size is not limited by the
+//! texture or viewport size limits. Each tile gets its own orthographic
+//! camera and only draws the triangles overlapping it; at most
+//! kTileReadbackDepth tiles are held in memory. Always uses the geometry
+//! shader pipeline, the reordered triangles do not match the face normals.
+void writeTiledTexture(const string& filename,
+                       const GLsizei output_width,
+                       const GLsizei output_height)
+{
+  assert(phong_yuv_va);
+  const GlStateCache::Bypass gl_state_bypass(gl_state);
+  const GLfloat x_min = scene_extent[0];
+  const GLfloat x_max = scene_extent[1];
+  const GLfloat y_min = scene_extent[2];
+  const GLfloat y_max = scene_extent[3];
+  const GLfloat z_min = scene_extent[4];
+  const GLfloat z_max = scene_extent[5];
+  const size_t tiles_x = (output_width + fbo_width - 1) / fbo_width;
+  const size_t tiles_y = (output_height + fbo_height - 1) / fbo_height;
+  const size_t tile_count = tiles_x * tiles_y;
+  const MeshLevel& level = selectMeshLevel(output_width);
+
+  // Sort the triangles of the level by tile, a triangle is listed once for
+  // every tile its bounding box overlaps. Reads the mesh back from its
+  // buffers, the CPU arrays are gone after the upload.
+  vector<GLuint> tile_offsets(tile_count + 1, 0);
+  unique_ptr<ElementArrayBuffer> tiled_ibo;
+  {
+    vector<Vec3f> pos(level.vertex_count);
+    vector<Triangle> tris(level.triangle_count);
+    glBindBuffer(GL_COPY_READ_BUFFER, obj_pos_vbo->handle());
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, pos.size() * sizeof(Vec3f),
+                       pos.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, tri_index_ibo->handle());
+    glGetBufferSubData(GL_COPY_READ_BUFFER,
+                       level.triangle_offset * sizeof(Triangle),
+                       tris.size() * sizeof(Triangle), tris.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    GL_CHECK("glGetBufferSubData");
+
+    const GLfloat tile_scale_x =
+      output_width / ((x_max - x_min) * fbo_width);
+    const GLfloat tile_scale_y =
+      output_height / ((y_max - y_min) * fbo_height);
+    const auto tileRange = [&](const Triangle& t, size_t* x0, size_t* x1,
+                               size_t* y0, size_t* y1) {
+      const Vec3f& a = pos[t.i];
+      const Vec3f& b = pos[t.j];
+      const Vec3f& c = pos[t.k];
+      const auto tile = [](const GLfloat f, const size_t n) {
+        return static_cast<size_t>(
+          min(max(f, 0.f), static_cast<GLfloat>(n - 1)));
+      };
+      *x0 = tile((min(min(a[0], b[0]), c[0]) - x_min) * tile_scale_x, tiles_x);
+      *x1 = tile((max(max(a[0], b[0]), c[0]) - x_min) * tile_scale_x, tiles_x);
+      *y0 = tile((min(min(a[1], b[1]), c[1]) - y_min) * tile_scale_y, tiles_y);
+      *y1 = tile((max(max(a[1], b[1]), c[1]) - y_min) * tile_scale_y, tiles_y);
+    };
+    size_t x0, x1, y0, y1;
+    for (const Triangle& t : tris) {
+      tileRange(t, &x0, &x1, &y0, &y1);
+      for (size_t y = y0; y <= y1; ++y) {
+        for (size_t x = x0; x <= x1; ++x) {
+          ++tile_offsets[y * tiles_x + x + 1];
+        }
+      }
+    }
+    partial_sum(tile_offsets.begin(), tile_offsets.end(),
+                tile_offsets.begin());
+    vector<Triangle> tiled_tris(tile_offsets.back());
+    vector<GLuint> fill(tile_offsets.begin(), tile_offsets.end() - 1);
+    for (const Triangle& t : tris) {
+      tileRange(t, &x0, &x1, &y0, &y1);
+      for (size_t y = y0; y <= y1; ++y) {
+        for (size_t x = x0; x <= x1; ++x) {
+          tiled_tris[fill[y * tiles_x + x]++] = t;
+        }
+      }
+    }
+    tiled_ibo.reset(new ElementArrayBuffer(
+      tiled_tris.size() * sizeof(Triangle), tiled_tris.data()));
+  }
+
+  TiledPpmWriter writer(filename, output_width, output_height);
+  PixelReadbackRing tile_readback(kTileReadbackDepth);
+  {
+    const Bindor<CachedShaderProgram> phong_yuv_bindor(*phong_yuv);
+    const Bindor<VertexArray> phong_yuv_va_bindor(*phong_yuv_va);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tiled_ibo->handle());
+    GL_CHECK("glBindBuffer");
+    array<GLfloat, 4> clear_color = { .5f, .5f, .5f, 1.f };
+    for (size_t ty = 0; ty < tiles_y; ++ty) {
+      for (size_t tx = 0; tx < tiles_x; ++tx) {
+        const GLsizei px = static_cast<GLsizei>(tx * fbo_width);
+        const GLsizei py = static_cast<GLsizei>(ty * fbo_height);
+        const GLsizei width = min(fbo_width, output_width - px);
+        const GLsizei height = min(fbo_height, output_height - py);
+
+        // Camera covering exactly this tile's pixels.
+        const GLfloat sx = (x_max - x_min) / output_width;
+        const GLfloat sy = (y_max - y_min) / output_height;
+        const array<GLfloat, 2 * 16> camera =
+          cameraData(x_min + px * sx, x_min + (px + width) * sx,
+                     y_min + py * sy, y_min + (py + height) * sy,
+                     z_min, z_max);
+        updateUniformBlock(camera_block, camera.data());
+
+        fbo->bind(GL_DRAW_FRAMEBUFFER);
+        viewport(0, 0, width, height);
+        array<GLenum, 1> draw_bufs = { GL_COLOR_ATTACHMENT0 };
+        drawBuffers(draw_bufs);
+        clearBufferfv(GL_COLOR, 0, clear_color.data());
+        const size_t tile = ty * tiles_x + tx;
+        const GLsizei index_count =
+          3 * (tile_offsets[tile + 1] - tile_offsets[tile]);
+        if (index_count > 0) {
+          drawRangeElements(
+            GL_TRIANGLES,
+            0,
+            static_cast<GLuint>(level.vertex_count) - 1,
+            index_count,
+            GLTypeEnum<GLuint>::value,
+            reinterpret_cast<const GLvoid*>(
+              tile_offsets[tile] * sizeof(Triangle)));
+        }
+        fbo->release(GL_DRAW_FRAMEBUFFER);
+
+        fbo->bind(GL_READ_FRAMEBUFFER);
+        readBuffer(GL_COLOR_ATTACHMENT0);
+        tile_readback.read(
+          0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, sizeof(Pixel8ui),
+          [&writer, px, py, width, height](const void* pixels) {
+            writer.writeTile(px, py, width, height, pixels);
+          });
+        fbo->release(GL_READ_FRAMEBUFFER);
+        tile_readback.poll();
+      }
+    }
+    tile_readback.finish();
+
+    // Restore the mesh indices in the vertex array and the full camera.
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tri_index_ibo->handle());
+  }
+  const array<GLfloat, 2 * 16> camera =
+    cameraData(x_min, x_max, y_min, y_max, z_min, z_max);
+  updateUniformBlock(camera_block, camera.data());
+  scene_dirty = true;
+
+  if (!writer.good()) {
+    throw runtime_error("could not write " + filename);
+  }
+  cout << "wrote " << output_width << "x" << output_height << " in "
+       << tile_count << " tiles, " << tile_offsets.back() << " tile triangles"
+       << endl;
+}
+
+//! Renders batch_size variants of the scene mesh, with consecutive seeds,
+//! into the layers of a 2D texture array and writes them as
+//! batch-NNNN.ppm. All meshes share one vertex and index buffer and are
+//! drawn with a single multi-draw call; each draw's base instance selects
+//! the layer through an instanced attribute, which phong_yuv.gs writes to
+//! gl_Layer. All layers are read back with one call.
+void renderBatch(const uint32_t batch_size)
+{
+  const GlStateCache::Bypass gl_state_bypass(gl_state);
+  const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<future<unique_ptr<MeshData>>> mesh_futures;
+  for (uint32_t b = 0; b < batch_size; ++b) {
+    MeshParams params = scene_mesh_params;
+    params.seed += b;
+    mesh_futures.push_back(async(launch::async, loadMesh, params));
+  }
+  vector<unique_ptr<MeshData>> meshes;
+  for (auto& f : mesh_futures) {
+    meshes.push_back(f.get());
+  }
+  const chrono::steady_clock::time_point loaded = chrono::steady_clock::now();
+
+  // Concatenate the meshes. Indices stay relative to their mesh, each draw
+  // adds its base vertex.
+  struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+  };
+  vector<DrawElementsIndirectCommand> commands;
+  size_t vertex_count = 0;
+  size_t triangle_count = 0;
+  for (uint32_t b = 0; b < batch_size; ++b) {
+    mesh_levels = meshes[b]->levels;
+    const MeshLevel& level = selectMeshLevel(fbo_width);
+    const DrawElementsIndirectCommand command = {
+      static_cast<GLuint>(3 * level.triangle_count),
+      1,
+      static_cast<GLuint>(3 * (triangle_count + level.triangle_offset)),
+      static_cast<GLint>(vertex_count),
+      b };
+    commands.push_back(command);
+    vertex_count += meshes[b]->vertex_count;
+    triangle_count += meshes[b]->triangle_count;
+  }
+  mesh_levels.clear();
+  const ArrayBuffer batch_obj_pos_vbo(vertex_count * sizeof(Vec3f), nullptr);
+  const ArrayBuffer batch_yuv_vbo(vertex_count * sizeof(Vec3f), nullptr);
+  const ElementArrayBuffer batch_tri_index_ibo(
+    triangle_count * sizeof(Triangle), nullptr);
+  {
+    size_t vertex_offset = 0;
+    size_t triangle_offset = 0;
+    for (const auto& mesh : meshes) {
+      const size_t vertex_bytes = mesh->vertex_count * sizeof(Vec3f);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, batch_obj_pos_vbo.handle());
+      glBufferSubData(GL_COPY_WRITE_BUFFER, vertex_offset * sizeof(Vec3f),
+                      vertex_bytes, mesh->obj_pos_data);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, batch_yuv_vbo.handle());
+      glBufferSubData(GL_COPY_WRITE_BUFFER, vertex_offset * sizeof(Vec3f),
+                      vertex_bytes, mesh->yuv_data);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, batch_tri_index_ibo.handle());
+      glBufferSubData(GL_COPY_WRITE_BUFFER,
+                      triangle_offset * sizeof(Triangle),
+                      mesh->triangle_count * sizeof(Triangle),
+                      mesh->tri_index_data);
+      vertex_offset += mesh->vertex_count;
+      triangle_offset += mesh->triangle_count;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    GL_CHECK("glBufferSubData");
+  }
+  meshes.clear();
+  vector<GLfloat> layers(batch_size);
+  iota(layers.begin(), layers.end(), 0.f);
+  const ArrayBuffer batch_layer_vbo(layers.size() * sizeof(GLfloat),
+                                    layers.data());
+
+  VertexArray batch_va;
+  batch_va.bind();
+  const CachedShaderProgram::Attrib obj_pos_attrib =
+    phong_yuv->activeAttrib("obj_pos");
+  const CachedShaderProgram::Attrib yuv_attrib = phong_yuv->activeAttrib("yuv");
+  const CachedShaderProgram::Attrib layer_attrib =
+    phong_yuv->activeAttrib("layer");
+  {
+    const Bindor<ArrayBuffer> vbo_bindor(batch_obj_pos_vbo);
+    const VertexAttribArrayEnabler vaae(obj_pos_attrib.location);
+    vertexAttribPointer(obj_pos_attrib.location, 3,
+                        VertexAttribType<GLfloat>::VALUE, GL_FALSE, 0, 0);
+  }
+  {
+    const Bindor<ArrayBuffer> vbo_bindor(batch_yuv_vbo);
+    const VertexAttribArrayEnabler vaae(yuv_attrib.location);
+    vertexAttribPointer(yuv_attrib.location, 3,
+                        VertexAttribType<GLfloat>::VALUE, GL_FALSE, 0, 0);
+  }
+  {
+    const Bindor<ArrayBuffer> vbo_bindor(batch_layer_vbo);
+    const VertexAttribArrayEnabler vaae(layer_attrib.location);
+    vertexAttribPointer(layer_attrib.location, 1,
+                        VertexAttribType<GLfloat>::VALUE, GL_FALSE, 0, 0);
+    glVertexAttribDivisor(layer_attrib.location, 1); // One per draw.
+    GL_CHECK("glVertexAttribDivisor");
+  }
+  const Bindor<ElementArrayBuffer> tri_index_bindor(batch_tri_index_ibo);
+  batch_va.release();
+
+  // Layered render target, one layer per variant.
+  GLuint layers_tex = 0;
+  glGenTextures(1, &layers_tex);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, layers_tex);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGB8, fbo_width, fbo_height,
+                 batch_size);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  GL_CHECK("glTexStorage3D");
+  Framebuffer batch_fbo;
+  batch_fbo.bind(GL_DRAW_FRAMEBUFFER);
+  glFramebufferTexture(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                       layers_tex, 0);
+  GL_CHECK("glFramebufferTexture");
+  viewport(0, 0, fbo_width, fbo_height);
+  array<GLenum, 1> draw_bufs = { GL_COLOR_ATTACHMENT0 };
+  drawBuffers(draw_bufs);
+  array<GLfloat, 4> clear_color = { .5f, .5f, .5f, 1.f };
+  clearBufferfv(GL_COLOR, 0, clear_color.data()); // Clears all layers.
+  {
+    const Bindor<CachedShaderProgram> phong_yuv_bindor(*phong_yuv);
+    const Bindor<VertexArray> batch_va_bindor(batch_va);
+    if (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect) {
+      GLuint indirect_buffer = 0;
+      glGenBuffers(1, &indirect_buffer);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+      glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                   commands.size() * sizeof(DrawElementsIndirectCommand),
+                   commands.data(), GL_STATIC_DRAW);
+      glMultiDrawElementsIndirect(GL_TRIANGLES, GLTypeEnum<GLuint>::value,
+                                  nullptr, batch_size, 0);
+      GL_CHECK("glMultiDrawElementsIndirect");
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+      glDeleteBuffers(1, &indirect_buffer);
+    }
+    else {
+      for (const DrawElementsIndirectCommand& c : commands) {
+        glDrawElementsInstancedBaseVertexBaseInstance(
+          GL_TRIANGLES, c.count, GLTypeEnum<GLuint>::value,
+          reinterpret_cast<const GLvoid*>(c.first_index * sizeof(GLuint)),
+          c.instance_count, c.base_vertex, c.base_instance);
+      }
+      GL_CHECK("glDrawElementsInstancedBaseVertexBaseInstance");
+    }
+  }
+  batch_fbo.release(GL_DRAW_FRAMEBUFFER);
+
+  // All layers in one readback.
+  vector<Pixel8ui> img(static_cast<size_t>(fbo_width) * fbo_height *
+                       batch_size);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, layers_tex);
+  glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, GL_UNSIGNED_BYTE,
+                img.data());
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  GL_CHECK("glGetTexImage");
+  glDeleteTextures(1, &layers_tex);
+  const chrono::steady_clock::time_point rendered = chrono::steady_clock::now();
+
+  for (uint32_t b = 0; b < batch_size; ++b) {
+    char filename[32];
+    snprintf(filename, sizeof(filename), "batch-%04u.ppm", b);
+    writePpm(filename, fbo_width, fbo_height,
+             &img[static_cast<size_t>(fbo_width) * fbo_height * b]);
+  }
+  const auto ms = [](const chrono::steady_clock::duration d) {
+    return chrono::duration<double, milli>(d).count();
+  };
+  cout << "batch of " << batch_size << ": load " << ms(loaded - start)
+       << " ms, upload + draw + readback " << ms(rendered - loaded)
+       << " ms (" << ms(rendered - loaded) / batch_size << " ms per variant)"
+       << endl;
+}
+
+//! Writes the final image: tiled, planar YUV, or the FBO as PPM.
+void writeOutput()
+{
+  if (options.output_width > 0) {
+    writeTiledTexture("tex.ppm", options.output_width, options.output_height);
+  }
+  else if (options.output_format != kRgbOutput) {
+    renderPlanarYuv();
+    writePlanarYuv(options.output_format == kNv12Output ? "tex.nv12"
+                                                        : "tex.i420",
+                   options.output_format);
+  }
+  else {
+    renderTexture();
+    writeTexture("tex.ppm");
+  }
+}
+
+//! Prints the --profile pass timings and writes them as JSON. Needs the
+//! context for the outstanding queries.
+void writeProfile()
+{
+  if (!profiler) {
+    return;
+  }
+  profiler->finish();
+  profiler->report(cout);
+  if (!profiler->writeJson(options.profile_filename)) {
+    throw runtime_error("could not write " + options.profile_filename);
+  }
+  profiler.reset();
 }
 
 int main(int argc, char* argv[])
 {
+  const chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+  const auto msSinceStart = [start_time]() {
+    return chrono::duration<double, milli>(
+      chrono::steady_clock::now() - start_time).count();
+  };
+
   try {
+    parseOptions(argc, argv);
+    if (options.headless) {
+      // Init, one draw and readback: no window, swap or event loop.
+      initHeadless();
+      initGLEW();
+      initGL();
+      buildShaderPrograms();
+      initScene();
+      if (options.batch_size > 0) {
+        renderBatch(options.batch_size);
+        writeProfile();
+        readback.reset();
+        cout << "headless render: " << msSinceStart() << " ms" << endl;
+        return EXIT_SUCCESS;
+      }
+      finishMesh();
+      if (options.bench_frames > 0 || options.bench_seconds > 0.) {
+        benchmarkFrames();
+      }
+      if (options.bench_pipelines > 0) {
+        benchmarkPipelines(options.bench_pipelines);
+      }
+      if (options.bench_raster > 0) {
+        benchmarkRaster(options.bench_raster);
+      }
+      if (options.light_sweep > 0) {
+        renderLightSweep(options.light_sweep);
+      }
+      writeOutput();
+      writeProfile();
+      readback.reset();
+      cout << "headless render: " << msSinceStart() << " ms" << endl;
+      return EXIT_SUCCESS;
+    }
+
     initGLFW(win_width, win_height);
     initGLEW();
     initGL();
     buildShaderPrograms();
     initScene();
-    initScreen();
+    if (options.batch_size > 0) {
+      renderBatch(options.batch_size);
+      writeProfile();
+      readback.reset();
+      glfwDestroyWindow(win);
+      glfwTerminate();
+      return EXIT_SUCCESS;
+    }
+    if (options.quad_present || options.bench_present > 0) {
+      initScreen();
+    }
+    if (options.bench_present > 0) {
+      finishMesh();
+      renderTexture();
+      benchmarkPresent(options.bench_present);
+    }
+    if (options.bench_frames > 0 || options.bench_seconds > 0.) {
+      finishMesh();
+      benchmarkFrames();
+    }
+    if (options.bench_pipelines > 0) {
+      finishMesh();
+      benchmarkPipelines(options.bench_pipelines);
+    }
+    if (options.bench_raster > 0) {
+      finishMesh();
+      benchmarkRaster(options.bench_raster);
+    }
+    if (options.light_sweep > 0) {
+      finishMesh();
+      renderLightSweep(options.light_sweep);
+    }
 
+    bool first_frame = true;
+    double last_profile_report = 0.;
+    chrono::steady_clock::time_point next_frame = chrono::steady_clock::now();
+    uint32_t captured_frames = 0;
     while (!glfwWindowShouldClose(win))
     {
-      renderTexture();
-      renderScreen();
-
-      // Swap front and back buffers, poll for and process events.
-      glfwSwapBuffers(win);
-      glfwPollEvents();
+      const bool mesh_completed = updateMesh();
+
+      // Only the time changes, the vertex shader moves the vertices. A
+      // finished --capture keeps its last frame instead of redrawing it.
+      const bool capture_done = options.capture_frames > 0 &&
+        captured_frames == options.capture_frames;
+      if (animating() && !capture_done) {
+        const GLfloat time = options.capture_frames > 0
+          ? captured_frames / kCaptureFps // Even steps for videos.
+          : static_cast<GLfloat>(msSinceStart() * 1e-3);
+        const AnimationData animation = animationData(time);
+        updateUniformBlock(animation_block, &animation);
+        scene_dirty = true;
+        gbuffer_dirty = true;
+      }
+
+      // Only redraw what is out of date, unless benchmarking.
+      if (scene_dirty || options.continuous) {
+        renderTexture();
+        scene_dirty = false;
+        screen_dirty = true;
+        if (captured_frames < options.capture_frames) {
+          char filename[32];
+          snprintf(filename, sizeof(filename), "frame-%04u.ppm",
+                   captured_frames++);
+          captureTexture(filename);
+        }
+      }
+      readback->poll();
+      if (profiler) {
+        profiler->poll();
+        if (msSinceStart() - last_profile_report > kProfileReportMs) {
+          profiler->report(cout);
+          cout << "gl state calls last frame: " << gl_state.frameIssued()
+               << " issued, " << gl_state.frameSkipped() << " skipped"
+               << endl;
+          last_profile_report = msSinceStart();
+        }
+      }
+      if (screen_dirty) {
+        renderScreen();
+        glfwSwapBuffers(win);
+        screen_dirty = false;
+      }
+      gl_state.endFrame();
+
+      // Optional frame rate cap, mainly for --continuous.
+      if (options.fps_limit > 0.) {
+        next_frame += chrono::duration_cast<chrono::steady_clock::duration>(
+          chrono::duration<double>(1. / options.fps_limit));
+        const chrono::steady_clock::time_point now =
+          chrono::steady_clock::now();
+        if (next_frame < now) {
+          next_frame = now; // Fell behind, do not try to catch up.
+        }
+        else {
+          this_thread::sleep_until(next_frame);
+        }
+      }
+
+      // Block until there are events, except while the mesh is still being
+      // built, uploaded or read back, which needs the loop to keep running.
+      if (options.continuous || animating() || mesh_future.valid() ||
+          pending_mesh || readback->busy()) {
+        glfwPollEvents();
+      }
+      else {
+        glfwWaitEvents();
+      }
+
+      if (first_frame) {
+        cout << "time to first frame: " << msSinceStart() << " ms" << endl;
+        first_frame = false;
+      }
+      if (mesh_completed) {
+        cout << "time to full mesh: " << msSinceStart() << " ms" << endl;
+      }
     }
 
-    writeTexture("tex.ppm");
+    // Closed before the mesh was done, finish it so the output is complete.
+    finishMesh();
+    writeOutput();
+    writeProfile();
+    readback.reset(); // Needs the context.
 
     // Close window and terminate GLFW.
     glfwDestroyWindow(win);
@@ -0,0 +1,18 @@
+#version 420 core 
+
+// Full resolution Cb Cr written by phong_yuv_planar.fs.
+layout(binding = 0) uniform sampler2D cbcr_full;
+
+layout(location = 0) out vec2 frag_cbcr;
+
+void main(void)
+{
+  // Average of the 2x2 full resolution block, clamped at odd edges.
+  ivec2 size = textureSize(cbcr_full, 0);
+  ivec2 p = 2 * ivec2(gl_FragCoord.xy);
+  ivec2 q = min(p + 1, size - 1);
+  frag_cbcr = 0.25 * (texelFetch(cbcr_full, p, 0).rg +
+                      texelFetch(cbcr_full, ivec2(q.x, p.y), 0).rg +
+                      texelFetch(cbcr_full, ivec2(p.x, q.y), 0).rg +
+                      texelFetch(cbcr_full, q, 0).rg);
+}
@@ -0,0 +1,43 @@
+#version 420 core 
+
+layout(std140) uniform Material {
+  vec4 material_front_diffuse_color;
+};
+
+layout(std140) uniform LightColor {
+  vec4 light_diffuse_color;
+};
+
+layout(std140) uniform LightDirection {
+  vec4 light_direction;
+};
+
+// Written by phong_yuv_gbuffer.fs, same size as the output.
+layout(binding = 0) uniform sampler2D gbuffer_normal;
+layout(binding = 1) uniform sampler2D gbuffer_yuv;
+
+layout(location = 0) out vec4 frag_color;
+
+void main(void)
+{
+  ivec2 texel = ivec2(gl_FragCoord.xy);
+  vec4 normal = texelFetch(gbuffer_normal, texel, 0);
+  if (normal.a == 0.0) {
+    discard; // No triangle, keep the clear color.
+  }
+  vec3 yuv = texelFetch(gbuffer_yuv, texel, 0).xyz;
+
+  mat3 rgb_from_yuv = mat3(
+    1.0,      1.0,     1.0,     // Column 0
+    0.0,     -0.21482, 2.12798,
+    1.28033, -0.38059, 0.0);
+  vec4 rgb = vec4(rgb_from_yuv * yuv, 1.0);
+
+  vec3 frag_normal = normalize(normal.xyz);
+  vec3 frag_light_direction = -normalize(light_direction.xyz);
+
+  float diffuse = max(dot(frag_normal, frag_light_direction), 0.0);
+
+  frag_color = rgb *
+    (diffuse * (light_diffuse_color * material_front_diffuse_color));
+}
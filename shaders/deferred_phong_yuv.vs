@@ -0,0 +1,7 @@
+#version 420 core
+
+void main(void) {
+  // Full-screen triangle from the vertex index, no attributes.
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  gl_Position = vec4(2.0 * p - 1.0, 0.0, 1.0);
+}
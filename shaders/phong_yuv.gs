@@ -14,6 +14,7 @@ layout(std140) uniform Model {
 };
 
 in vec3 yuv_vs[];
+flat in int layer_vs[];
 
 flat out vec3 world_normal;
 smooth out vec3 yuv_gs;
@@ -39,14 +40,17 @@ void main(void)
 
   yuv_gs = yuv_vs[0];
   gl_Position = clip_from_obj * obj_pos0;
+  gl_Layer = layer_vs[0]; // Ignored unless the framebuffer is layered.
   EmitVertex();
 
   yuv_gs = yuv_vs[1];
   gl_Position = clip_from_obj * obj_pos1;
+  gl_Layer = layer_vs[0];
   EmitVertex();
 
   yuv_gs = yuv_vs[2];
   gl_Position = clip_from_obj * obj_pos2;
+  gl_Layer = layer_vs[0];
   EmitVertex();
 
   EndPrimitive();
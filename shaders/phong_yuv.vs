@@ -1,10 +1,46 @@
-#version 420 core 
+#version 420 core
+
+// Procedural vertex animation, evaluated per vertex so the vertex buffers
+// never change. Zero amplitudes leave the mesh as uploaded.
+layout(std140) uniform Animation {
+  float time; // Seconds.
+  float z_amplitude; // Largest z offset, object space.
+  float frequency; // Noise keys per second.
+  uint seed;
+  vec4 uv_amplitude; // xy: largest u and v offsets.
+};
 
 in vec3 obj_pos; // Object space vertex coordinates.
 in vec3 yuv;
+in float layer; // Per instance, 0 unless batch rendering.
 out vec3 yuv_vs;
+flat out int layer_vs;
+
+uint hash(uint x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// Value noise in [-1, 1] over time, independent per vertex and channel.
+float noise(uint channel, float t) {
+  float key = floor(t);
+  uint vertex_key = hash(uint(gl_VertexID) ^ hash(seed + channel));
+  float a = float(hash(vertex_key ^ uint(key))) / 4294967295.0;
+  float b = float(hash(vertex_key ^ uint(key + 1.0))) / 4294967295.0;
+  return 2.0 * mix(a, b, smoothstep(0.0, 1.0, t - key)) - 1.0;
+}
 
 void main(void) {
+  float t = time * frequency;
+  vec3 pos = obj_pos;
+  pos.z += z_amplitude * noise(0u, t);
   yuv_vs = yuv;
-  gl_Position = vec4(obj_pos, 1.0);
+  yuv_vs.y += uv_amplitude.x * noise(1u, t);
+  yuv_vs.z += uv_amplitude.y * noise(2u, t);
+  layer_vs = int(layer);
+  gl_Position = vec4(pos, 1.0);
 }
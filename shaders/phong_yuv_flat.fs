@@ -0,0 +1,46 @@
+#version 420 core 
+
+layout(std140) uniform Material {
+  vec4 material_front_diffuse_color;
+};
+
+layout(std140) uniform LightColor {
+  vec4 light_diffuse_color;
+};
+
+layout(std140) uniform LightDirection {
+  vec4 light_direction;
+};
+
+layout(std140) uniform Model {
+  mat4 world_from_obj;
+  mat4 world_from_obj_normal;
+};
+
+// Object space face normals, one per triangle of the mesh.
+layout(binding = 0) uniform samplerBuffer face_normals;
+
+// Index of the first triangle of the draw, gl_PrimitiveID starts at 0.
+uniform int primitive_offset;
+
+smooth in vec3 yuv_vs;
+
+layout(location = 0) out vec4 frag_color;
+
+void main(void)
+{
+  mat3 rgb_from_yuv = mat3(
+    1.0,      1.0,     1.0,     // Column 0
+    0.0,     -0.21482, 2.12798,
+    1.28033, -0.38059, 0.0);
+  vec4 rgb = vec4(rgb_from_yuv * yuv_vs, 1.0);
+
+  vec3 obj_normal = texelFetch(face_normals, primitive_offset + gl_PrimitiveID).xyz;
+  vec3 frag_normal = normalize(mat3(world_from_obj_normal) * obj_normal);
+  vec3 frag_light_direction = -normalize(light_direction.xyz);
+
+  float diffuse = max(dot(frag_normal, frag_light_direction), 0.0);
+
+  frag_color = rgb *
+    (diffuse * (light_diffuse_color * material_front_diffuse_color));
+}
@@ -0,0 +1,21 @@
+#version 420 core
+
+layout(std140) uniform Camera {
+  mat4 view_from_world;
+  mat4 clip_from_view;
+};
+
+layout(std140) uniform Model {
+  mat4 world_from_obj;
+  mat4 world_from_obj_normal;
+};
+
+in vec3 obj_pos; // Object space vertex coordinates.
+in vec3 yuv;
+smooth out vec3 yuv_vs;
+
+void main(void) {
+  yuv_vs = yuv;
+  gl_Position =
+    clip_from_view * view_from_world * world_from_obj * vec4(obj_pos, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 420 core 
+
+flat in vec3 world_normal;
+smooth in vec3 yuv_gs;
+
+// G-buffer, alpha marks covered pixels.
+layout(location = 0) out vec4 gbuffer_normal;
+layout(location = 1) out vec4 gbuffer_yuv;
+
+void main(void)
+{
+  gbuffer_normal = vec4(world_normal, 1.0);
+  gbuffer_yuv = vec4(yuv_gs, 1.0);
+}
@@ -0,0 +1,44 @@
+#version 420 core 
+
+layout(std140) uniform Material {
+  vec4 material_front_diffuse_color;
+};
+
+layout(std140) uniform LightColor {
+  vec4 light_diffuse_color;
+};
+
+layout(std140) uniform LightDirection {
+  vec4 light_direction;
+};
+
+flat in vec3 world_normal;
+smooth in vec3 yuv_gs;
+
+// Full-range YCbCr planes: Y, and Cb Cr at full resolution for
+// chroma_downsample.fs.
+layout(location = 0) out float frag_y;
+layout(location = 1) out vec2 frag_cbcr;
+
+void main(void)
+{
+  mat3 rgb_from_yuv = mat3(
+    1.0,      1.0,     1.0,     // Column 0
+    0.0,     -0.21482, 2.12798,
+    1.28033, -0.38059, 0.0);
+  vec4 rgb = vec4(rgb_from_yuv * yuv_gs, 1.0);
+
+  vec3 frag_normal = normalize(world_normal);
+  vec3 frag_light_direction = -normalize(light_direction.xyz);
+
+  float diffuse = max(dot(frag_normal, frag_light_direction), 0.0);
+
+  vec3 lit = clamp((rgb *
+    (diffuse * (light_diffuse_color * material_front_diffuse_color))).rgb,
+    0.0, 1.0);
+
+  // Same as the RGB path, then BT.601 luma and chroma scaled to [0, 1].
+  float y = dot(lit, vec3(0.299, 0.587, 0.114));
+  frag_y = y;
+  frag_cbcr = vec2(0.5 + (lit.b - y) / 1.772, 0.5 + (lit.r - y) / 1.402);
+}
@@ -0,0 +1,42 @@
+// Bins each triangle of a mesh level into the tiles its pixel bounding box
+// overlaps. Runs twice: the count pass sizes the tile lists and collects
+// the large triangles, the fill pass writes the lists.
+
+layout(local_size_x = 64) in;
+
+uniform uint triangle_offset; // First triangle of the level.
+uniform uint triangle_count;
+uniform bool fill_pass;
+
+void main(void) {
+  uint t = triangle_offset + gl_GlobalInvocationID.x;
+  if (gl_GlobalInvocationID.x >= triangle_count) {
+    return;
+  }
+  Triangle tri = setupTriangle(t);
+  ivec2 pixel_min;
+  ivec2 pixel_max;
+  pixelBounds(tri, pixel_min, pixel_max);
+  if (tri.inv_area == 0.0 || any(greaterThan(pixel_min, pixel_max))) {
+    return; // Culled, or covers no pixel centers.
+  }
+
+  ivec2 tile_min = pixel_min / kTileSize;
+  ivec2 tile_max = pixel_max / kTileSize;
+  if (any(greaterThan(tile_max - tile_min, ivec2(1)))) {
+    if (!fill_pass) {
+      large_triangle[atomicAdd(large_count, 1u)] = t;
+    }
+    return;
+  }
+
+  for (int y = tile_min.y; y <= tile_max.y; ++y) {
+    for (int x = tile_min.x; x <= tile_max.x; ++x) {
+      uint end = uint(2 * (y * tiles.x + x) + 1);
+      uint slot = atomicAdd(tile_range[end], 1u);
+      if (fill_pass) {
+        tile_triangle[slot] = t;
+      }
+    }
+  }
+}
@@ -0,0 +1,221 @@
+#version 430 core
+
+// Shared by the compute rasterizer passes, prepended to each of them.
+// Screen tiles are kTileSize pixels square; triangles whose pixel bounding
+// box fits in 2x2 tiles are binned, larger ones go to a separate list.
+// Each pixel is owned by at most one triangle, so the output does not
+// depend on the order in which the passes find the triangles.
+
+const int kTileSize = 16;
+
+// Same binding points as in buildShaderPrograms().
+layout(std140, binding = 1) uniform Camera {
+  mat4 view_from_world;
+  mat4 clip_from_view;
+};
+
+layout(std140, binding = 5) uniform Model {
+  mat4 world_from_obj;
+  mat4 world_from_obj_normal;
+};
+
+layout(std140, binding = 4) uniform Material {
+  vec4 material_front_diffuse_color;
+};
+
+layout(std140, binding = 2) uniform LightColor {
+  vec4 light_diffuse_color;
+};
+
+layout(std140, binding = 3) uniform LightDirection {
+  vec4 light_direction;
+};
+
+// Mesh buffers, vec3 elements tightly packed.
+layout(std430, binding = 0) readonly buffer ObjPos {
+  float obj_pos[];
+};
+
+layout(std430, binding = 1) readonly buffer Yuv {
+  float yuv[];
+};
+
+layout(std430, binding = 2) readonly buffer TriIndex {
+  uint tri_index[];
+};
+
+// Begin and end of each tile's list in tile_triangle, interleaved. The
+// count pass accumulates counts in the ends, the scan pass turns them
+// into offsets, the fill pass moves the ends back to the list ends.
+layout(std430, binding = 3) buffer TileRanges {
+  uint tile_range[];
+};
+
+layout(std430, binding = 4) buffer TileTriangles {
+  uint tile_triangle[];
+};
+
+// Triangles too large to bin, rasterized one per invocation. The first
+// three words are the glDispatchComputeIndirect arguments of that pass.
+layout(std430, binding = 5) buffer LargeTriangles {
+  uint large_groups[3];
+  uint large_count;
+  uint large_triangle[];
+};
+
+layout(binding = 0, rgba8) writeonly uniform image2D rgb_image;
+
+// Index + 1 of the triangle owning each pixel, 0 for none. Overlapping
+// triangles resolve to the highest index, i.e. the last one the graphics
+// pipeline would draw.
+layout(binding = 1, r32ui) uniform uimage2D owner_image;
+
+uniform ivec2 tiles; // Tile grid size.
+
+// Vertices are snapped to 1/kSubpixels of a pixel, so coverage is decided
+// with exact integer edge functions. Vertices beyond kGuardBand pixels
+// would overflow them.
+const int kSubpixelBits = 8;
+const int kSubpixels = 1 << kSubpixelBits;
+const int kHalfPixel = kSubpixels / 2;
+const float kGuardBand = 32768.0;
+
+// Screen space triangle with shaded vertex colors.
+struct Triangle {
+  ivec2 p0; // Window coordinates in subpixels.
+  ivec2 p1;
+  ivec2 p2;
+  float inv_area; // Of the parallelogram in subpixels; 0 if not drawn.
+  vec3 rgb0;
+  vec3 rgb1;
+  vec3 rgb2;
+};
+
+vec3 objPos(uint i) {
+  return vec3(obj_pos[3 * i], obj_pos[3 * i + 1], obj_pos[3 * i + 2]);
+}
+
+vec3 vertexYuv(uint i) {
+  return vec3(yuv[3 * i], yuv[3 * i + 1], yuv[3 * i + 2]);
+}
+
+// Snapped window coordinates of a clip space position. False if the
+// vertex is outside the near or far plane or the guard band. The graphics
+// pipeline clips such triangles; this path drops them whole, which the
+// meshes here never need, as they lie inside the camera's depth range.
+bool windowPos(vec4 clip, out ivec2 p) {
+  p = ivec2(0);
+  if (clip.w <= 0.0 || abs(clip.z) > clip.w) {
+    return false;
+  }
+  vec2 window = (clip.xy / clip.w * 0.5 + 0.5) * vec2(imageSize(rgb_image));
+  if (any(greaterThan(abs(window), vec2(kGuardBand)))) {
+    return false;
+  }
+  p = ivec2(round(window * float(kSubpixels)));
+  return true;
+}
+
+// Sign of a * b - c * d, exact through 64-bit products.
+int signOfDifference(int a, int b, int c, int d) {
+  int ab_msb;
+  int ab_lsb;
+  int cd_msb;
+  int cd_lsb;
+  imulExtended(a, b, ab_msb, ab_lsb);
+  imulExtended(c, d, cd_msb, cd_lsb);
+  if (ab_msb != cd_msb) {
+    return ab_msb > cd_msb ? 1 : -1;
+  }
+  uint ab = uint(ab_lsb);
+  uint cd = uint(cd_lsb);
+  return ab == cd ? 0 : (ab > cd ? 1 : -1);
+}
+
+// True if q is left of the edge a->b of a counter-clockwise triangle, or
+// on it and the edge is a top or left edge. A shared edge is seen in
+// opposite directions by its two triangles, so exactly one owns q.
+bool insideEdge(ivec2 a, ivec2 b, ivec2 q) {
+  ivec2 d = b - a;
+  int side = signOfDifference(d.x, q.y - a.y, d.y, q.x - a.x);
+  return side > 0 || (side == 0 && (d.y < 0 || (d.y == 0 && d.x < 0)));
+}
+
+// Same transform and shading as phong_yuv.vs/.gs/.fs: face normal from
+// the object space positions, diffuse lighting of the converted vertex
+// colors. Lighting is linear in the color, so shading the vertices and
+// interpolating equals interpolating yuv and shading the pixel. Back
+// faces are culled, as glCullFace(GL_BACK) does for the graphics pipeline.
+Triangle setupTriangle(uint t) {
+  uint i0 = tri_index[3 * t];
+  uint i1 = tri_index[3 * t + 1];
+  uint i2 = tri_index[3 * t + 2];
+  vec3 obj_pos0 = objPos(i0);
+  vec3 obj_pos1 = objPos(i1);
+  vec3 obj_pos2 = objPos(i2);
+
+  mat4 clip_from_obj = clip_from_view * view_from_world * world_from_obj;
+  Triangle tri;
+  tri.inv_area = 0.0;
+  bool visible = windowPos(clip_from_obj * vec4(obj_pos0, 1.0), tri.p0);
+  visible = windowPos(clip_from_obj * vec4(obj_pos1, 1.0), tri.p1) && visible;
+  visible = windowPos(clip_from_obj * vec4(obj_pos2, 1.0), tri.p2) && visible;
+  ivec2 d1 = tri.p1 - tri.p0;
+  ivec2 d2 = tri.p2 - tri.p0;
+  if (visible && signOfDifference(d1.x, d2.y, d1.y, d2.x) > 0) {
+    // At least 1 when positive, the coordinates are integers.
+    tri.inv_area = 1.0 / max(float(d1.x) * float(d2.y) -
+                             float(d1.y) * float(d2.x), 1.0);
+  }
+
+  vec3 obj_normal = cross(obj_pos2 - obj_pos1, obj_pos0 - obj_pos1);
+  vec3 world_normal = normalize(mat3(world_from_obj_normal) * obj_normal);
+  vec3 frag_light_direction = -normalize(light_direction.xyz);
+  float diffuse = max(dot(world_normal, frag_light_direction), 0.0);
+  vec3 scale =
+    diffuse * (light_diffuse_color * material_front_diffuse_color).rgb;
+
+  mat3 rgb_from_yuv = mat3(
+    1.0,      1.0,     1.0,     // Column 0
+    0.0,     -0.21482, 2.12798,
+    1.28033, -0.38059, 0.0);
+  tri.rgb0 = scale * (rgb_from_yuv * vertexYuv(i0));
+  tri.rgb1 = scale * (rgb_from_yuv * vertexYuv(i1));
+  tri.rgb2 = scale * (rgb_from_yuv * vertexYuv(i2));
+  return tri;
+}
+
+// Center of a pixel in subpixels.
+ivec2 pixelCenter(ivec2 pixel) {
+  return pixel * kSubpixels + kHalfPixel;
+}
+
+// Inclusive range of pixels whose centers lie in the triangle's bounding
+// box, clipped to the image. Empty if min > max.
+void pixelBounds(Triangle tri, out ivec2 pixel_min, out ivec2 pixel_max) {
+  ivec2 lo = min(min(tri.p0, tri.p1), tri.p2);
+  ivec2 hi = max(max(tri.p0, tri.p1), tri.p2);
+  // Arithmetic shifts, which round toward minus infinity.
+  pixel_min = max((lo - kHalfPixel + kSubpixels - 1) >> kSubpixelBits,
+                  ivec2(0));
+  pixel_max = min((hi - kHalfPixel) >> kSubpixelBits,
+                  imageSize(rgb_image) - 1);
+}
+
+// True if the triangle owns the pixel center q, see insideEdge().
+bool covers(Triangle tri, ivec2 q) {
+  return insideEdge(tri.p1, tri.p2, q) && insideEdge(tri.p2, tri.p0, q) &&
+         insideEdge(tri.p0, tri.p1, q);
+}
+
+// Interpolated color at the pixel center q. Only coverage needs to be
+// exact, so this uses floats, relative to q to keep them small.
+vec3 interpolate(Triangle tri, ivec2 q) {
+  vec2 a = vec2(tri.p0 - q);
+  vec2 b = vec2(tri.p1 - q);
+  vec2 c = vec2(tri.p2 - q);
+  vec3 weights = vec3(b.x * c.y - b.y * c.x,
+                      c.x * a.y - c.y * a.x,
+                      a.x * b.y - a.y * b.x) * tri.inv_area;
+  return weights.x * tri.rgb0 + weights.y * tri.rgb1 + weights.z * tri.rgb2;
+}
@@ -0,0 +1,36 @@
+// Rasterizes the triangles the bin pass could not bin, one per invocation
+// looping over its pixel bounding box. Runs after the tile pass, twice:
+// the first pass claims the owned pixels in owner_image, keeping the
+// highest triangle number as the tile pass does, the resolve pass writes
+// the pixels each triangle kept. Rare when the compute rasterizer is
+// chosen for small triangles.
+
+layout(local_size_x = 64) in;
+
+uniform bool resolve_pass;
+
+void main(void) {
+  if (gl_GlobalInvocationID.x >= large_count) {
+    return;
+  }
+  uint t = large_triangle[gl_GlobalInvocationID.x];
+  Triangle tri = setupTriangle(t);
+  ivec2 pixel_min;
+  ivec2 pixel_max;
+  pixelBounds(tri, pixel_min, pixel_max);
+  for (int y = pixel_min.y; y <= pixel_max.y; ++y) {
+    for (int x = pixel_min.x; x <= pixel_max.x; ++x) {
+      ivec2 pixel = ivec2(x, y);
+      ivec2 q = pixelCenter(pixel);
+      if (!covers(tri, q)) {
+        continue;
+      }
+      if (!resolve_pass) {
+        imageAtomicMax(owner_image, pixel, t + 1u);
+      }
+      else if (imageLoad(owner_image, pixel).r == t + 1u) {
+        imageStore(rgb_image, pixel, vec4(interpolate(tri, q), 1.0));
+      }
+    }
+  }
+}
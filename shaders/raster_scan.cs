@@ -0,0 +1,46 @@
+// Turns the per-tile counts of the bin count pass into list offsets with
+// an exclusive prefix sum, and sizes the dispatch of the large triangle
+// pass. A single work group; each invocation sums a run of tiles.
+
+layout(local_size_x = 1024) in;
+
+shared uint run_offset[1024];
+
+void main(void) {
+  uint tile_count = uint(tiles.x * tiles.y);
+  uint run = (tile_count + 1023u) / 1024u;
+  uint first = gl_LocalInvocationIndex * run;
+  uint last = min(first + run, tile_count);
+
+  uint sum = 0u;
+  for (uint i = first; i < last; ++i) {
+    sum += tile_range[2 * i + 1];
+  }
+  run_offset[gl_LocalInvocationIndex] = sum;
+  barrier();
+
+  // Hillis-Steele inclusive scan of the run sums.
+  for (uint stride = 1u; stride < 1024u; stride *= 2u) {
+    uint value = run_offset[gl_LocalInvocationIndex];
+    if (gl_LocalInvocationIndex >= stride) {
+      value += run_offset[gl_LocalInvocationIndex - stride];
+    }
+    barrier();
+    run_offset[gl_LocalInvocationIndex] = value;
+    barrier();
+  }
+
+  uint offset = run_offset[gl_LocalInvocationIndex] - sum;
+  for (uint i = first; i < last; ++i) {
+    uint count = tile_range[2 * i + 1];
+    tile_range[2 * i] = offset;
+    tile_range[2 * i + 1] = offset;
+    offset += count;
+  }
+
+  if (gl_LocalInvocationIndex == 0u) {
+    large_groups[0] = (large_count + 63u) / 64u;
+    large_groups[1] = 1u;
+    large_groups[2] = 1u;
+  }
+}
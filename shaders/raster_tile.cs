@@ -0,0 +1,68 @@
+// Shades one screen tile per work group, one pixel per invocation. The
+// tile's triangles are set up cooperatively in batches in shared memory,
+// then every pixel takes the color of the highest numbered triangle that
+// owns its center, or the clear color. Writes every pixel of rgb_image and
+// owner_image, so neither needs a clear.
+
+layout(local_size_x = 16, local_size_y = 16) in; // kTileSize squared.
+
+const uint kBatch = uint(kTileSize * kTileSize);
+
+uniform vec4 clear_color;
+
+shared ivec4 batch_p01[kBatch];
+shared ivec2 batch_p2[kBatch];
+shared float batch_inv_area[kBatch];
+shared uint batch_triangle[kBatch];
+shared vec3 batch_rgb0[kBatch];
+shared vec3 batch_rgb1[kBatch];
+shared vec3 batch_rgb2[kBatch];
+
+void main(void) {
+  uint tile = gl_WorkGroupID.y * uint(tiles.x) + gl_WorkGroupID.x;
+  uint begin = tile_range[2 * tile];
+  uint end = tile_range[2 * tile + 1];
+  ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+  ivec2 q = pixelCenter(pixel);
+
+  vec4 color = clear_color;
+  uint owner = 0u;
+  for (uint first = begin; first < end; first += kBatch) {
+    uint i = first + gl_LocalInvocationIndex;
+    if (i < end) {
+      uint t = tile_triangle[i];
+      Triangle tri = setupTriangle(t);
+      batch_p01[gl_LocalInvocationIndex] = ivec4(tri.p0, tri.p1);
+      batch_p2[gl_LocalInvocationIndex] = tri.p2;
+      batch_inv_area[gl_LocalInvocationIndex] = tri.inv_area;
+      batch_triangle[gl_LocalInvocationIndex] = t;
+      batch_rgb0[gl_LocalInvocationIndex] = tri.rgb0;
+      batch_rgb1[gl_LocalInvocationIndex] = tri.rgb1;
+      batch_rgb2[gl_LocalInvocationIndex] = tri.rgb2;
+    }
+    barrier();
+
+    // The list order comes from atomics; the winner does not.
+    uint count = min(kBatch, end - first);
+    for (uint j = 0u; j < count; ++j) {
+      Triangle tri;
+      tri.p0 = batch_p01[j].xy;
+      tri.p1 = batch_p01[j].zw;
+      tri.p2 = batch_p2[j];
+      tri.inv_area = batch_inv_area[j];
+      tri.rgb0 = batch_rgb0[j];
+      tri.rgb1 = batch_rgb1[j];
+      tri.rgb2 = batch_rgb2[j];
+      if (batch_triangle[j] + 1u > owner && covers(tri, q)) {
+        color = vec4(interpolate(tri, q), 1.0);
+        owner = batch_triangle[j] + 1u;
+      }
+    }
+    barrier();
+  }
+
+  if (all(lessThan(pixel, imageSize(rgb_image)))) {
+    imageStore(rgb_image, pixel, color);
+    imageStore(owner_image, pixel, uvec4(owner));
+  }
+}
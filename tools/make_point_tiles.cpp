@@ -0,0 +1,46 @@
+// Builds the set of periodic blue-noise point tiles that makeMesh() maps
+// at startup when run with --mesh=tiles.
+//
+// Usage: make-point-tiles <output file> [tile count] [points per tile]
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "../Parallel.hpp"
+#include "../PointTiles.hpp"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0]
+         << " <output file> [tile count] [points per tile]" << endl;
+    return EXIT_FAILURE;
+  }
+  const string filename = argv[1];
+  const size_t tile_count = argc > 2 ? atoi(argv[2]) : 8;
+  const size_t target_points = argc > 3 ? atoi(argv[3]) : 4096;
+
+  // Bridson fills about one sample per 1.5 r^2.
+  const float radius = static_cast<float>(sqrt(1.0 / (1.5 * target_points)));
+  vector<vector<array<float, 2>>> tiles(tile_count);
+  parallelFor(tile_count, 1, [&](const size_t begin, const size_t end) {
+    for (size_t t = begin; t < end; ++t) {
+      tiles[t] = makePeriodicPoissonTile(radius, static_cast<uint32_t>(t));
+    }
+  });
+
+  for (size_t t = 0; t < tile_count; ++t) {
+    cout << "tile " << t << ": " << tiles[t].size() << " points" << endl;
+  }
+  if (!PointTileSet::write(filename, radius, tiles)) {
+    cerr << "Could not write " << filename << endl;
+    return EXIT_FAILURE;
+  }
+  cout << "wrote " << filename << " (radius " << radius << ")" << endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+// Compares the jittered lattice mesher with Poisson sampling followed by
+// Delaunay triangulation: build time and skinny-triangle statistics, for
+// meshes with about the same vertex count.
+//
+// Usage: mesh-bench [max_exponent] [jitter]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "../LatticeMesh.hpp"
+#include "../PoissonSampling.hpp"
+#include "../Triangulate.hpp"
+
+using namespace std;
+
+typedef array<float, 2> Point;
+
+struct Tri
+{
+  Tri() : i(0), j(0), k(0) {}
+  Tri(const uint32_t i, const uint32_t j, const uint32_t k)
+    : i(i), j(j), k(k) {}
+  uint32_t i;
+  uint32_t j;
+  uint32_t k;
+};
+
+struct QualityStats
+{
+  double min_angle; // Degrees, worst triangle.
+  double mean_min_angle; // Degrees.
+  double below_20; // Fraction of triangles with an angle below 20 degrees.
+  double below_30;
+  double mean_aspect; // Longest edge over shortest altitude, 2/sqrt(3) best.
+};
+
+QualityStats qualityStats(const vector<Point>& pos, const vector<Tri>& tris)
+{
+  QualityStats stats = { 180.0, 0.0, 0.0, 0.0, 0.0 };
+  for (size_t t = 0; t < tris.size(); ++t) {
+    const Point& a = pos[tris[t].i];
+    const Point& b = pos[tris[t].j];
+    const Point& c = pos[tris[t].k];
+    const double ab = hypot(b[0] - a[0], b[1] - a[1]);
+    const double bc = hypot(c[0] - b[0], c[1] - b[1]);
+    const double ca = hypot(a[0] - c[0], a[1] - c[1]);
+    const double area = 0.5 * fabs((b[0] - a[0]) * (c[1] - a[1]) -
+                                   (c[0] - a[0]) * (b[1] - a[1]));
+    // Smallest angle is opposite the shortest edge.
+    const double shortest = min(ab, min(bc, ca));
+    const double longest = max(ab, max(bc, ca));
+    const double other = ab + bc + ca - shortest - longest;
+    const double cos_min = (longest * longest + other * other -
+                            shortest * shortest) / (2.0 * longest * other);
+    const double angle = acos(max(-1.0, min(1.0, cos_min))) * 180.0 / M_PI;
+    stats.min_angle = min(stats.min_angle, angle);
+    stats.mean_min_angle += angle;
+    stats.below_20 += angle < 20.0 ? 1.0 : 0.0;
+    stats.below_30 += angle < 30.0 ? 1.0 : 0.0;
+    stats.mean_aspect += longest * longest / (2.0 * area);
+  }
+  const double n = static_cast<double>(max<size_t>(tris.size(), 1));
+  stats.mean_min_angle /= n;
+  stats.below_20 /= n;
+  stats.below_30 /= n;
+  stats.mean_aspect /= n;
+  return stats;
+}
+
+template <typename F>
+double elapsedMs(F f)
+{
+  const auto t0 = chrono::steady_clock::now();
+  f();
+  const auto t1 = chrono::steady_clock::now();
+  return chrono::duration<double, milli>(t1 - t0).count();
+}
+
+void printRow(const char* name, const size_t vertex_count,
+              const size_t triangle_count, const double ms,
+              const QualityStats& q)
+{
+  cout << name << "\t" << vertex_count << "\t" << triangle_count << "\t"
+       << ms << "\t" << q.min_angle << "\t" << q.mean_min_angle << "\t"
+       << 100.0 * q.below_20 << "\t" << 100.0 * q.below_30 << "\t"
+       << q.mean_aspect << endl;
+}
+
+int main(int argc, char* argv[])
+{
+  const int max_exponent = argc > 1 ? atoi(argv[1]) : 6;
+  const float jitter = argc > 2 ? static_cast<float>(atof(argv[2])) : 0.2f;
+  const uint32_t seed = 1954;
+  const Point x_min = {{ 0.f, 0.f }};
+  const Point x_max = {{ 1000.f, 1000.f }};
+  const double area = (x_max[0] - x_min[0]) * (x_max[1] - x_min[1]);
+
+  cout << setprecision(4);
+  cout << "mesh\tvertices\ttriangles\tms\tmin_angle\tmean_min_angle"
+       << "\t%<20deg\t%<30deg\tmean_aspect" << endl;
+  for (int e = 4; e <= max_exponent; ++e) {
+    const double target = pow(10.0, e);
+    const float radius = static_cast<float>(sqrt(area / (1.5 * target)));
+
+    vector<Point> poisson_pos;
+    vector<Tri> poisson_tris;
+    const double poisson_ms = elapsedMs([&]() {
+      poisson_pos = tiledPoissonDiskSampling(radius, x_min, x_max, 30, seed);
+      triangulate(poisson_pos, &poisson_tris);
+    });
+    printRow("poisson+delaunay", poisson_pos.size(), poisson_tris.size(),
+             poisson_ms, qualityStats(poisson_pos, poisson_tris));
+
+    // Same vertex density as the Poisson mesh.
+    const float spacing =
+      static_cast<float>(sqrt(area / poisson_pos.size()));
+    vector<Point> lattice_pos;
+    vector<Tri> lattice_tris;
+    const double lattice_ms = elapsedMs([&]() {
+      makeJitteredLattice(spacing, jitter, x_min, x_max, seed,
+                          &lattice_pos, &lattice_tris);
+    });
+    printRow("lattice", lattice_pos.size(), lattice_tris.size(),
+             lattice_ms, qualityStats(lattice_pos, lattice_tris));
+  }
+  return EXIT_SUCCESS;
+}
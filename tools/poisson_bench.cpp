@@ -0,0 +1,78 @@
+// Compares the serial thinks::poissonDiskSampling() call used by makeMesh()
+// so far with tiledPoissonDiskSampling(), for 10^4 to 10^7 samples.
+//
+// Usage: poisson-bench [max_exponent]
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <thinks/poissonDiskSampling.hpp>
+
+#include "../PoissonSampling.hpp"
+
+using namespace std;
+
+typedef array<float, 2> Point;
+
+template <typename F>
+double elapsedMs(F f)
+{
+  const auto t0 = chrono::steady_clock::now();
+  f();
+  const auto t1 = chrono::steady_clock::now();
+  return chrono::duration<double, milli>(t1 - t0).count();
+}
+
+//! Grid based check that no two samples are closer than radius.
+bool checkMinDistance(const vector<Point>& samples, const float radius,
+                      const Point& x_min, const Point& x_max)
+{
+  detail::PoissonGrid<float> grid(radius, x_min, x_max);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    if (!grid.isFree(samples[i])) {
+      return false;
+    }
+    grid.add(samples[i]);
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  const int max_exponent = argc > 1 ? atoi(argv[1]) : 7;
+  const uint32_t seed = 1954;
+  const Point x_min = {{ 0.f, 0.f }};
+  const Point x_max = {{ 1000.f, 1000.f }};
+  const float area = (x_max[0] - x_min[0]) * (x_max[1] - x_min[1]);
+
+  cout << "threads: " << workerCount() << endl;
+  cout << "target\tradius\tserial_n\tserial_ms\ttiled_n\ttiled_ms\tspeedup\tmin_dist_ok"
+       << endl;
+  for (int e = 4; e <= max_exponent; ++e) {
+    const double target = pow(10.0, e);
+    // Bridson fills about one sample per 1.5 r^2.
+    const float radius = static_cast<float>(sqrt(area / (1.5 * target)));
+
+    vector<Point> serial;
+    const double serial_ms = elapsedMs([&]() {
+      serial = thinks::poissonDiskSampling(radius, x_min, x_max, 30, seed);
+    });
+    vector<Point> tiled;
+    const double tiled_ms = elapsedMs([&]() {
+      tiled = tiledPoissonDiskSampling(radius, x_min, x_max, 30, seed);
+    });
+
+    cout << static_cast<size_t>(target) << "\t" << radius << "\t"
+         << serial.size() << "\t" << serial_ms << "\t"
+         << tiled.size() << "\t" << tiled_ms << "\t"
+         << serial_ms / tiled_ms << "\t"
+         << (checkMinDistance(tiled, radius, x_min, x_max) ? "yes" : "NO")
+         << endl;
+  }
+  return EXIT_SUCCESS;
+}